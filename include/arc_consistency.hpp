@@ -1,9 +1,16 @@
 #pragma once
 
 #include "constraint.hpp"
+#include "cow_vector.hpp"
+#include "domain_universe.hpp"
+#include "trace.hpp"
+#include <atomic>
 #include <functional>
+#include <limits>
+#include <map>
 #include <memory>
 #include <queue>
+#include <typeindex>
 #ifdef ARCCONSISTENCY_ENABLE_LISTENERS
 #include <set>
 #endif
@@ -26,6 +33,124 @@ namespace arc_consistency
     bool value;
   };
 
+  /**
+   * @brief The outcome of a (possibly partial) propagation.
+   */
+  enum class propagation_status
+  {
+    fixpoint,  // all the pending wake-ups have been processed
+    suspended, // the wake-up budget ran out before reaching the fixpoint
+    conflict   // a domain has been emptied
+  };
+
+  /**
+   * @brief The variable ordering heuristics available to the search.
+   */
+  enum class var_heuristic
+  {
+    dom,      // smallest domain first
+    dom_wdeg, // smallest ratio between domain size and the conflict weights of the constraints on the variable
+    impact    // smallest ratio between domain size and the average number of values pruned by the decisions on the variable
+  };
+
+  /**
+   * @brief The parameters of the backtracking search.
+   */
+  struct search_options
+  {
+    var_heuristic heuristic = var_heuristic::dom_wdeg; // the variable ordering heuristic
+    bool restarts = true;                              // whether the search restarts, following the Luby sequence
+    std::size_t restart_base = 100;                    // the number of conflicts in a unit of the Luby sequence
+    bool learning = false;                             // whether nogoods are learned, as clauses, from the conflicts
+    std::size_t max_nogood_size = 8;                   // the size of the longest nogood to be learned
+    std::size_t max_learnts = 1000;                    // the number of learned nogoods beyond which the least active half is forgotten
+    unsigned seed = 0;                                 // if not zero, the seed for choosing the values to branch on at random
+  };
+
+  /**
+   * @brief The number of constraints simplified by a presolve, by kind of simplification.
+   */
+  struct presolve_report
+  {
+    std::size_t folded = 0;     // the unary constraints applied to the initial domains
+    std::size_t duplicates = 0; // the constraints identical to an active one
+    std::size_t subsumed = 0;   // the clauses implied by a shorter active one
+    std::size_t entailed = 0;   // the constraints whose variables are all fixed at the root level
+  };
+
+  /**
+   * @brief The estimated number of bytes used by a solver, by internal structure.
+   *
+   * The pages shared with the forks of the solver are counted in full by each of them.
+   */
+  struct memory_report
+  {
+    std::size_t domains = 0;                                      // the current domains, as sets and as bitsets
+    std::size_t init_domains = 0;                                 // the initial domains
+    std::size_t watchlists = 0;                                   // the watchlists
+    std::unordered_map<std::type_index, std::size_t> constraints; // the constraints created, or adopted, by the solver, by type
+    std::size_t learnts = 0;                                      // the learned nogoods and their activities
+    std::size_t queue = 0;                                        // the propagation queue and the parked wake-ups
+    std::size_t search = 0;                                       // the trail, the checkpoints, the changes of the constraints, the decisions and the impacts
+    std::size_t listeners = 0;                                    // the listener maps
+    std::size_t other = 0;                                        // the universes, the active constraints and the presolve bookkeeping
+
+    [[nodiscard]] std::size_t total() const noexcept;
+  };
+
+  /**
+   * @brief The explanation of a conflict.
+   *
+   * The conflict is a consequence of the `constraints` once the values in `assumptions` have been removed by the search.
+   */
+  struct explanation
+  {
+    std::vector<constraint *> constraints;                                   // the constraints involved in the conflict
+    std::vector<std::pair<utils::var, const utils::enum_val *>> assumptions; // the removals, due to decisions, the conflict depends on
+  };
+
+  /**
+   * @brief An immutable view of the domains of the variables of a solver, as they were when the snapshot was published.
+   *
+   * Snapshots share the unchanged pages of domains with the solver and with each other, so they can be read from any thread while the solver keeps being modified.
+   */
+  class domain_snapshot
+  {
+  public:
+    domain_snapshot(std::size_t version, const cow_vector<std::unordered_set<const utils::enum_val *>> &dom) noexcept : version(version), dom(dom) {}
+
+    /**
+     * @brief Gets the version of this snapshot, which increases with each publication.
+     */
+    [[nodiscard]] std::size_t get_version() const noexcept { return version; }
+    /**
+     * @brief Gets the number of variables in this snapshot.
+     */
+    [[nodiscard]] std::size_t size() const noexcept { return dom.size(); }
+
+    /**
+     * @brief Gets the domain of a variable, as it was when this snapshot was published.
+     */
+    [[nodiscard]] const std::unordered_set<const utils::enum_val *> &domain(utils::var v) const noexcept { return dom.at(v); }
+    /**
+     * @brief Gets the SAT value of a variable, as it was when this snapshot was published.
+     */
+    [[nodiscard]] utils::lbool sat_val(const utils::var &x) const noexcept;
+    /**
+     * @brief Gets the SAT value of a literal, as it was when this snapshot was published.
+     */
+    [[nodiscard]] utils::lbool sat_val(const utils::lit &l) const noexcept;
+    /**
+     * @brief Checks if a value was allowed in the domain of a variable when this snapshot was published.
+     */
+    [[nodiscard]] bool allows(utils::var v, const utils::enum_val &val) const noexcept { return dom.at(v).count(&val); }
+
+  private:
+    const std::size_t version;
+    const cow_vector<std::unordered_set<const utils::enum_val *>> dom;
+  };
+
+  class portfolio;
 #ifdef ARCCONSISTENCY_ENABLE_LISTENERS
   class listener;
 #endif
@@ -33,6 +158,7 @@ namespace arc_consistency
   class solver
   {
     friend class constraint;
+    friend class portfolio;
 #ifdef ARCCONSISTENCY_ENABLE_LISTENERS
     friend class listener;
 #endif
@@ -43,6 +169,15 @@ namespace arc_consistency
 
     solver() noexcept;
 
+    /**
+     * @brief Creates a fork of this solver, sharing its structure.
+     *
+     * The domains, the watchlists and the constraints of this solver are shared with the fork, and copied lazily as either of them modifies them: domains and watchlists page by page, constraints one at a time as the fork propagates them. The fork starts from the root level of this solver, without its learned nogoods, and can be modified independently from it. The constraints created by this solver can be added to, and retracted from, the fork. This solver must outlive the fork.
+     *
+     * @return std::unique_ptr<solver> The fork of this solver.
+     */
+    [[nodiscard]] std::unique_ptr<solver> fork() const noexcept;
+
     /**
      * @brief Creates and returns a new SAT variable.
      *
@@ -145,6 +280,47 @@ namespace arc_consistency
      * @return constraint& A reference to the newly created forbid constraint.
      */
     [[nodiscard]] constraint &new_forbid(utils::var x, const utils::enum_val &val) noexcept;
+    /**
+     * @brief Creates a new at-most-k constraint.
+     *
+     * This function creates a new cardinality constraint enforcing that at most `k` of the specified literals are true.
+     *
+     * @param lits The literals to be counted.
+     * @param k The maximum number of true literals.
+     * @return constraint& A reference to the newly created cardinality constraint.
+     */
+    [[nodiscard]] constraint &new_at_most(std::vector<utils::lit> &&lits, std::size_t k) noexcept;
+    /**
+     * @brief Creates a new exactly-k constraint.
+     *
+     * This function creates a new cardinality constraint enforcing that exactly `k` of the specified literals are true.
+     *
+     * @param lits The literals to be counted.
+     * @param k The number of true literals.
+     * @return constraint& A reference to the newly created cardinality constraint.
+     */
+    [[nodiscard]] constraint &new_exactly(std::vector<utils::lit> &&lits, std::size_t k) noexcept;
+    /**
+     * @brief Creates a new element constraint.
+     *
+     * This function creates a new element constraint enforcing that `y = table[x]`, where `table` maps values of `x` to values of `y`. Values of `x` missing from the table are not allowed.
+     *
+     * @param y The variable taking the looked up value.
+     * @param x The variable used as index.
+     * @param table The pairs of values of `x` and of the corresponding values of `y`.
+     * @return constraint& A reference to the newly created element constraint.
+     */
+    [[nodiscard]] constraint &new_element(utils::var y, utils::var x, const std::vector<std::pair<std::reference_wrapper<const utils::enum_val>, std::reference_wrapper<const utils::enum_val>>> &table) noexcept;
+    /**
+     * @brief Creates a new global cardinality constraint.
+     *
+     * This function creates a new global cardinality constraint bounding, for each of the specified values, the number of variables taking it. Values without bounds are unconstrained.
+     *
+     * @param vars The variables to be counted.
+     * @param bounds The values, each with the minimum and the maximum number of variables taking it.
+     * @return constraint& A reference to the newly created global cardinality constraint.
+     */
+    [[nodiscard]] constraint &new_gcc(std::vector<utils::var> &&vars, const std::vector<std::tuple<std::reference_wrapper<const utils::enum_val>, std::size_t, std::size_t>> &bounds) noexcept;
 
     /**
      * @brief Adds a constraint to the solver.
@@ -157,7 +333,7 @@ namespace arc_consistency
     /**
      * @brief Retracts a constraint from the solver.
      *
-     * This function removes the specified constraint from the solver.
+     * This function removes the specified constraint from the solver, restoring the domains of the variables connected to it. If the solver is inconsistent, the domains of the variables connected to the conflict are restored as well. If the search has refuted values at the root level, the domains of all the variables are restored, since those refutations might follow from any constraint, the retracted one included.
      *
      * @param c The constraint to be retracted.
      */
@@ -171,7 +347,69 @@ namespace arc_consistency
      * @return true If no domain is emptied during propagation.
      * @return false If a domain is emptied during propagation.
      */
-    [[nodiscard]] bool propagate() noexcept;
+    [[nodiscard]] bool propagate() noexcept { return propagate(std::numeric_limits<std::size_t>::max()) != propagation_status::conflict; }
+    /**
+     * @brief Propagates the constraints in the solver for at most a given number of constraint wake-ups.
+     *
+     * This function performs arc consistency propagation, suspending as soon as `max_wakeups` constraints have been woken up. A suspended propagation is resumed, from where it stopped, by the next call to `propagate`. This allows running the propagation cooperatively, e.g. within an event loop.
+     *
+     * @param max_wakeups The maximum number of constraint wake-ups to perform.
+     * @return propagation_status `fixpoint` if the propagation is complete, `suspended` if the budget ran out, `conflict` if a domain is emptied during propagation.
+     */
+    [[nodiscard]] propagation_status propagate(std::size_t max_wakeups) noexcept;
+    /**
+     * @brief Enforces singleton arc consistency (SAC) on the solver.
+     *
+     * This function propagates the constraints and then, for each variable `x` and each value `v` in its domain, tentatively assigns `x = v`, propagates, and permanently removes `v` from the domain of `x` if the assignment leads to a conflict. The probes are undone through a trail, so they leave no trace on the domains of the variables besides the removed values. The process is repeated until no more values can be removed.
+     *
+     * With more than one worker, the probes of each round are shared among as many forks of the solver, each probing its values on its own thread, and the failed ones are removed once all the forks are done. The rounds are repeated until no more values can be removed, reaching the same domains as the sequential probing.
+     *
+     * @param n_workers The number of threads probing the values.
+     * @return true If no domain is emptied during propagation.
+     * @return false If a domain is emptied during propagation.
+     */
+    [[nodiscard]] bool singleton_propagate(std::size_t n_workers = 1) noexcept;
+    /**
+     * @brief Simplifies the active constraints at the root level.
+     *
+     * The `assign` and `forbid` constraints are applied to the initial domains of their variables and leave the watchlists. Duplicate constraints, and clauses subsumed by shorter ones, are set aside as long as the constraint standing for them is active. If the solver is at a fixpoint, the constraints whose variables are all fixed are set aside as well, until a retraction enlarges their domains. Retracting a simplified constraint undoes its simplification.
+     *
+     * @return presolve_report The number of constraints simplified, by kind of simplification.
+     */
+    presolve_report presolve() noexcept;
+
+    /**
+     * @brief Estimates the memory used by the solver, broken down by internal structure.
+     *
+     * @return memory_report The estimated number of bytes used by each structure.
+     */
+    [[nodiscard]] memory_report memory_usage() const noexcept;
+    /**
+     * @brief Releases the spare capacity of the internal containers, e.g. after a bulk load or many retractions.
+     *
+     * The pages shared with the forks of the solver are left untouched, so as not to copy them.
+     */
+    void shrink_to_fit() noexcept;
+
+    /**
+     * @brief Searches for an assignment of all the variables that satisfies the active constraints.
+     *
+     * This function performs a depth-first search, assigning variables according to the given heuristic and undoing the assignments through the trail upon conflicts. If a solution is found, it remains in the domains of the variables until the solver is next modified, or searched. If the active constraints are proven unsatisfiable, the solver stays inconsistent, with `propagate` and `solve` returning false, until a constraint is retracted.
+     *
+     * @param opts The parameters of the search.
+     * @return true If a solution has been found.
+     * @return false If the active constraints are unsatisfiable.
+     */
+    [[nodiscard]] bool solve(const search_options &opts = {}) noexcept;
+
+    /**
+     * @brief Explains the last conflict.
+     *
+     * This function walks back the trail from the last conflict, collecting the constraints responsible for the removals that led to it and the removals due to decisions. It is meaningful only after a propagation returned a conflict and before the solver is next modified.
+     *
+     * @return explanation The explanation of the last conflict.
+     */
+    [[nodiscard]] explanation explain_conflict() const noexcept;
 
     /**
      * @brief Checks if two literals can be matched.
@@ -209,6 +447,34 @@ namespace arc_consistency
      */
     [[nodiscard]] bool allows(utils::var v, const utils::enum_val &val) const noexcept;
 
+    /**
+     * @brief Publishes a snapshot of the current domains of the variables.
+     *
+     * This function is meant to be called by the thread modifying the solver, after a completed propagation. Publishing costs one reference count increment per page of domains: the pages are copied only when the solver next modifies them.
+     *
+     * @return std::size_t The version of the published snapshot.
+     */
+    std::size_t publish() noexcept;
+    /**
+     * @brief Gets the last published snapshot.
+     *
+     * This function can be called from any thread, concurrently with the modifications of the solver.
+     *
+     * @return std::shared_ptr<const domain_snapshot> The last published snapshot, or `nullptr` if none has been published.
+     */
+    [[nodiscard]] std::shared_ptr<const domain_snapshot> snapshot() const noexcept { return std::atomic_load(&published); }
+
+#ifdef ARCCONSISTENCY_ENABLE_TRACE
+    /**
+     * @brief Sets the buffer receiving the propagation, removal, conflict and retraction events of the solver, along with the refutations, restarts and nogoods of the search and the prunings of the singleton arc consistency.
+     *
+     * Recording an event costs a few stores into the buffer: the events are formatted, through `to_string`, only by the thread draining the buffer. The forks of the solver do not inherit the buffer, as each buffer has a single writer.
+     *
+     * @param buffer The buffer receiving the events, or `nullptr` to stop tracing.
+     */
+    void set_trace(trace_buffer *buffer) noexcept { tracer = buffer; }
+#endif
+
 #ifdef ARCCONSISTENCY_ENABLE_LISTENERS
   private:
     /**
@@ -233,15 +499,178 @@ namespace arc_consistency
     friend std::string to_string(const solver &s, utils::var v) noexcept;
 
   private:
-    [[nodiscard]] bool remove(utils::var v, const utils::enum_val &val, constraint &c) noexcept;
+    struct fork_tag
+    {
+    };
+    solver(const solver &parent, fork_tag) noexcept;
+
+    /**
+     * @brief Gets the instance of a constraint which is bound to this solver.
+     *
+     * Constraints inherited from the solvers this one has been forked from are cloned on first use.
+     */
+    [[nodiscard]] constraint *resolve(constraint *c) noexcept { return &c->slv == this ? c : adopt(c); }
+    [[nodiscard]] constraint *adopt(constraint *c) noexcept;
+    /**
+     * @brief Gets the constraint, as known to the users of this solver, an instance bound to this solver stands for.
+     */
+    [[nodiscard]] constraint *origin(constraint *c) const noexcept;
+    /**
+     * @brief Gets the conflict weight, within this solver, of a constraint.
+     */
+    [[nodiscard]] std::size_t weight_of(const constraint *c) const noexcept;
+
+    [[nodiscard]] bool remove(utils::var v, const utils::enum_val &val, constraint *c) noexcept;
+    /**
+     * @brief Restricts the domain of a variable to a single value, without any constraint being responsible for it.
+     *
+     * @param v The variable to be assigned.
+     * @param val The value to assign to the variable.
+     * @return true If no domain is emptied.
+     * @return false If the value is not in the domain of the variable.
+     */
+    [[nodiscard]] bool decide(utils::var v, const utils::enum_val &val) noexcept;
+
+    /**
+     * @brief Creates a checkpoint, from which the removals of values are recorded on the trail.
+     */
+    void push() noexcept;
+    /**
+     * @brief Restores the domains of the variables, and the state of the constraints, as they were at the last checkpoint.
+     *
+     * The removed values are put back into their domains through the nodes kept on the trail, so restoring does not allocate. Pending propagations are discarded, since the state at the checkpoint is assumed to be at a fixpoint.
+     */
+    void pop() noexcept;
+    /**
+     * @brief Undoes all the checkpoints, going back to the root level.
+     */
+    void backtrack_to_root() noexcept;
+
+    /**
+     * @brief Selects the next variable to branch on.
+     *
+     * @param h The variable ordering heuristic.
+     * @return utils::var The selected variable, or `utils::FALSE_var` if all the variables are assigned.
+     */
+    [[nodiscard]] utils::var select_var(var_heuristic h) const noexcept;
+
+    /**
+     * @brief Learns a nogood from the last conflict.
+     *
+     * The nogood is a clause stating that at least one of the assumptions of the conflict does not hold. It can be learned only if all the assumptions concern SAT variables.
+     *
+     * @param expl The explanation of the last conflict.
+     * @param max_size The size of the longest nogood to be learned.
+     * @return clause* The learned clause, not yet watched, or `nullptr` if no nogood can be learned.
+     */
+    [[nodiscard]] clause *learn(const explanation &expl, std::size_t max_size) noexcept;
+    /**
+     * @brief Starts watching a learned clause, scheduling it for propagation.
+     */
+    void activate_learnt(clause &c) noexcept;
+    /**
+     * @brief Adds a nogood learned elsewhere, e.g. by another solver of a portfolio.
+     *
+     * @param lits The literals of the nogood, at least one of which must hold.
+     */
+    void import_nogood(std::vector<utils::lit> &&lits) noexcept;
+    /**
+     * @brief Forgets the least active half of the learned clauses.
+     */
+    void reduce_learnts() noexcept;
+    /**
+     * @brief Forgets the given learned clauses, clearing the reasons that refer to them.
+     */
+    void forget_learnts(const std::unordered_set<const constraint *> &forgotten) noexcept;
+    /**
+     * @brief Enforces singleton arc consistency, from a propagated root level, sharing the probes among `n_workers` forks.
+     */
+    [[nodiscard]] bool parallel_singleton_propagate(std::size_t n_workers) noexcept;
+    /**
+     * @brief Removes the cleared removals from the trail, at the root level.
+     */
+    void compact_trail() noexcept;
+    /**
+     * @brief Sets the initial domain of the variable `v` to its universe, restricted by the unary constraints folded on it.
+     */
+    void refold(utils::var v) noexcept;
+    /**
+     * @brief Removes the constraint `c` from the watchlists, until `keeper` is retracted or, if `keeper` is `nullptr`, until the domains of `c` are restored.
+     */
+    void detach(constraint &c, constraint *keeper) noexcept;
+    /**
+     * @brief Puts back into the watchlists a constraint removed by `detach`.
+     */
+    void reattach(constraint &c) noexcept;
+    /**
+     * @brief Returns the bitset, over the universe of the variable `v`, of the values in `vals`.
+     */
+    [[nodiscard]] value_bitset bits_of(utils::var v, const std::unordered_set<const utils::enum_val *> &vals) const noexcept;
+    /**
+     * @brief Returns the bitset of the current domain of the variable `v`, keeping it in step with the domain from now on.
+     */
+    [[nodiscard]] const value_bitset &bits_in_step(utils::var v) noexcept;
+#ifdef ARCCONSISTENCY_ENABLE_TRACE
+    /**
+     * @brief Builds a trace event, referring to the learned nogoods by their sequence number rather than by their address.
+     */
+    [[nodiscard]] trace_event make_event(trace_kind kind, utils::var var, const utils::enum_val *val, const constraint *c) const noexcept;
+#endif
 
   private:
-    std::vector<std::unordered_set<const utils::enum_val *>> init_domain; // initial domains
-    std::vector<std::unordered_set<const utils::enum_val *>> dom;         // current domains
-    std::vector<std::unordered_set<constraint *>> watchlist;              // watchlist for each variable
-    std::vector<std::unique_ptr<constraint>> constraints;                 // all the constraints
-    std::unordered_set<constraint *> active_constraints;                  // currently active constraints
-    std::queue<std::pair<utils::var, constraint *>> to_propagate;         // variables to propagate
+    cow_vector<std::unordered_set<const utils::enum_val *>> init_domain;  // initial domains
+    cow_vector<std::unordered_set<const utils::enum_val *>> dom;          // current domains
+    cow_vector<std::unordered_set<constraint *>> watchlist;               // watchlist for each variable
+    std::map<std::vector<const utils::enum_val *>, std::shared_ptr<const domain_universe>> universe_of; // the universe of each value list
+    cow_vector<std::shared_ptr<const domain_universe>> universes;         // the universe of each variable
+    cow_vector<value_bitset> bits;                                        // current domains, as bitsets over the universes, for the variables in `kept_bits`
+    std::vector<bool> kept_bits;                                          // whether the bitset of each variable, once read by a constraint, is kept in step with its domain
+    std::vector<std::unique_ptr<constraint>> constraints;                 // the constraints created by this solver
+    std::unordered_map<const constraint *, std::unique_ptr<constraint>> adopted; // the instances of the inherited constraints, cloned on first use
+    std::unordered_map<const constraint *, constraint *> origins;        // for each adopted instance, the inherited constraint it stands for
+    std::shared_ptr<std::unordered_set<constraint *>> active_constraints; // currently active constraints, shared with the forks until modified
+    std::unordered_map<constraint *, utils::var> folded;                  // the unary constraints applied to the initial domains, with their variable
+    std::unordered_map<constraint *, constraint *> detached;              // the constraints set aside by the presolve, with the constraint standing for them (`nullptr` if entailed)
+    std::unordered_map<utils::var, std::unordered_set<constraint *>> detached_watches; // for each variable, the constraints set aside by the presolve on it
+    std::vector<std::pair<utils::var, constraint *>> to_propagate;        // variables to propagate, from `q_head` on, reused across propagations
+    std::size_t q_head = 0;                                               // the position, in `to_propagate`, of the next variable to propagate
+    std::vector<std::pair<utils::var, constraint *>> parked;              // wake-ups interrupted by a suspension, in reverse order
+    struct removal
+    {
+      utils::var var;             // the variable whose domain has been reduced
+      const utils::enum_val *val; // the removed value
+      constraint *reason;         // the constraint responsible for the removal, or `nullptr` if no constraint is
+      std::unordered_set<const utils::enum_val *>::node_type node; // the node extracted from the domain, put back on backtracking
+      std::size_t prev;           // the position, in the trail, of the previous removal from the same variable, or `no_removal`
+    };
+    static constexpr std::size_t no_removal = std::numeric_limits<std::size_t>::max();
+
+    std::vector<removal> trail;                                           // the removed values, in order of removal, cleared (with a null value) at the root level when restored
+    std::vector<std::size_t> last_removal;                                // for each variable, the position in the trail of its last removal, or `no_removal`
+    std::size_t n_cleared = 0;                                            // the number of cleared removals in the trail
+    std::vector<std::size_t> checkpoints;                                 // the size of the trail at each checkpoint
+    std::vector<std::pair<constraint *, std::size_t>> undos;              // the changes of the state of the constraints below the root level, in order
+    std::vector<std::size_t> undo_marks;                                  // the number of changes in `undos` at each checkpoint
+    std::vector<std::pair<utils::var, const utils::enum_val *>> decisions; // the decisions of the search, one for each checkpoint
+    cow_vector<double> impacts;                                           // for each variable, the average number of values pruned by deciding it
+    constraint *conflict = nullptr;                                       // the constraint that detected the last conflict, if any
+    bool inconsistent = false;                                            // whether a conflict has been detected at the root level, until the next retraction
+    bool refuted = false;                                                 // whether the search has refuted values at the root level, until the next retraction
+    std::vector<std::unique_ptr<clause>> learnts;                         // the learned nogoods
+    std::vector<std::vector<constraint *>> learnt_watches;                // for each variable, the learned nogoods watching it, kept apart from the watchlists shared with the forks
+    std::unordered_map<const constraint *, double> activity;              // the activity of each learned nogood
+    double activity_inc = 1;                                              // the activity bump for the learned nogoods involved in a conflict
+    const std::atomic<bool> *stop = nullptr;                              // if set, the search gives up as soon as it becomes true
+    std::function<void(const clause &)> on_learnt;                        // called for every learned nogood
+    std::function<void()> on_restart;                                     // called, at the root level, on every restart
+    std::shared_ptr<const domain_snapshot> published;                     // the last published snapshot, accessed atomically
+    std::size_t n_published = 0;                                          // the number of published snapshots
+    std::size_t n_restorations = 0;                                       // the number of retractions, each enlarging some domains
+#ifdef ARCCONSISTENCY_ENABLE_TRACE
+    trace_buffer *tracer = nullptr;                                 // the buffer receiving the trace events, if any
+    std::unordered_map<const constraint *, std::size_t> nogood_ids; // the sequence number of each learned nogood
+    std::size_t n_nogoods = 0;                                      // the number of nogoods learned, or imported, so far
+#endif
 #ifdef ARCCONSISTENCY_ENABLE_LISTENERS
     std::unordered_map<utils::var, std::set<listener *>> listening; // for each variable, the listeners listening to it..
     std::set<listener *> listeners;                                 // the collection of listeners..
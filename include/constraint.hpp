@@ -3,6 +3,11 @@
 #include "bool.hpp"
 #include "enum.hpp"
 #include "lit.hpp"
+#include "domain_universe.hpp"
+#include "memory_usage.hpp"
+#include <limits>
+#include <memory>
+#include <tuple>
 #include <vector>
 #include <unordered_set>
 #include <unordered_map>
@@ -13,21 +18,70 @@ namespace arc_consistency
 
   class constraint
   {
+    friend class solver;
+
   public:
     constraint(solver &slv) noexcept : slv(slv) {}
     virtual ~constraint() = default;
 
     virtual std::vector<utils::var> scope() const noexcept = 0;
     virtual bool propagate(utils::var v) noexcept = 0;
+    /**
+     * @brief Creates a copy of this constraint, bound to the given solver.
+     */
+    virtual std::unique_ptr<constraint> clone(solver &slv) const noexcept = 0;
+    /**
+     * @brief Estimates the number of bytes used by this constraint, including what it allocates on the heap.
+     */
+    virtual std::size_t memory_usage() const noexcept = 0;
 
     virtual std::string to_string() const noexcept = 0;
 
   protected:
     [[nodiscard]] bool remove(utils::var v, const utils::enum_val &val) noexcept;
-    [[nodiscard]] std::unordered_set<const utils::enum_val *> &domain(utils::var v) const noexcept;
+    /**
+     * @brief Gets the current domain of the variable `v`.
+     *
+     * Reading a domain does not copy the page it shares with the forks or the snapshots of the solver, but removing a value might: the returned reference must not be used across a call to `remove`.
+     */
+    [[nodiscard]] const std::unordered_set<const utils::enum_val *> &domain(utils::var v) const noexcept;
+    /**
+     * @brief Gets the universe of the values of the variable `v`, shared by all the variables created from the same value list.
+     */
+    [[nodiscard]] const domain_universe &universe(utils::var v) const noexcept;
+    /**
+     * @brief Gets the current domain of the variable `v` as a bitset over its universe.
+     *
+     * The solver keeps the bitset of a variable in step with its domain only from the first time it is read, so that the variables of the constraints not reading bitsets do not pay for them. As for `domain`, the returned reference must not be used across a call to `remove`.
+     */
+    [[nodiscard]] const value_bitset &bits(utils::var v) const noexcept;
+    /**
+     * @brief Gets the number of times the domains of the solver have been enlarged by retracting constraints.
+     *
+     * Constraints keeping incremental state can compare it against the value at their last update to know whether their state is still valid. Backtracking is not counted, since the changes of the state are undone through `save` and `undo`.
+     */
+    [[nodiscard]] std::size_t restorations() const noexcept;
+    /**
+     * @brief Records a change of the incremental state of this constraint, so that the solver calls `undo` with it when backtracking over the current level.
+     *
+     * Changes at the root level are not recorded, since only retractions, counted by `restorations`, go back over them.
+     */
+    void save(std::size_t change) noexcept;
+
+    static constexpr std::size_t recount = std::numeric_limits<std::size_t>::max(); // the change saved by a constraint which has rebuilt its whole state
 
   protected:
     solver &slv;
+
+  private:
+    /**
+     * @brief Undoes a change recorded through `save`, the most recent changes being undone first.
+     */
+    virtual void undo(std::size_t) noexcept {}
+
+  private:
+    std::size_t weight = 1;            // the number of conflicts this constraint has been involved in, plus one
+    std::vector<utils::var> scope_vars; // the scope, kept by the solver once the constraint is watched
   };
 
   class assign final : public constraint
@@ -35,8 +89,13 @@ namespace arc_consistency
   public:
     assign(solver &slv, utils::var v, const utils::enum_val &val) noexcept;
 
+    utils::var get_var() const noexcept { return v; }
+    const utils::enum_val &get_val() const noexcept { return val; }
+
     std::vector<utils::var> scope() const noexcept override;
     bool propagate(utils::var v) noexcept override;
+    std::unique_ptr<constraint> clone(solver &slv) const noexcept override;
+    std::size_t memory_usage() const noexcept override;
 
     std::string to_string() const noexcept override;
 
@@ -50,8 +109,13 @@ namespace arc_consistency
   public:
     forbid(solver &slv, utils::var v, const utils::enum_val &val) noexcept;
 
+    utils::var get_var() const noexcept { return v; }
+    const utils::enum_val &get_val() const noexcept { return val; }
+
     std::vector<utils::var> scope() const noexcept override;
     bool propagate(utils::var v) noexcept override;
+    std::unique_ptr<constraint> clone(solver &slv) const noexcept override;
+    std::size_t memory_usage() const noexcept override;
 
     std::string to_string() const noexcept override;
 
@@ -67,6 +131,8 @@ namespace arc_consistency
 
     std::vector<utils::var> scope() const noexcept override;
     bool propagate(utils::var v) noexcept override;
+    std::unique_ptr<constraint> clone(solver &slv) const noexcept override;
+    std::size_t memory_usage() const noexcept override;
 
     std::string to_string() const noexcept override;
 
@@ -82,8 +148,12 @@ namespace arc_consistency
   public:
     clause(solver &slv, std::vector<utils::lit> &&lits) noexcept;
 
+    const std::vector<utils::lit> &get_lits() const noexcept { return lits; }
+
     std::vector<utils::var> scope() const noexcept override;
     bool propagate(utils::var v) noexcept override;
+    std::unique_ptr<constraint> clone(solver &slv) const noexcept override;
+    std::size_t memory_usage() const noexcept override;
 
     std::string to_string() const noexcept override;
 
@@ -98,6 +168,8 @@ namespace arc_consistency
 
     std::vector<utils::var> scope() const noexcept override;
     bool propagate(utils::var v) noexcept override;
+    std::unique_ptr<constraint> clone(solver &slv) const noexcept override;
+    std::size_t memory_usage() const noexcept override;
 
     std::string to_string() const noexcept override;
 
@@ -113,6 +185,8 @@ namespace arc_consistency
 
     std::vector<utils::var> scope() const noexcept override;
     bool propagate(utils::var v) noexcept override;
+    std::unique_ptr<constraint> clone(solver &slv) const noexcept override;
+    std::size_t memory_usage() const noexcept override;
 
     std::string to_string() const noexcept override;
 
@@ -120,4 +194,102 @@ namespace arc_consistency
     const utils::var var1;
     const utils::var var2;
   };
+
+  class cardinality final : public constraint
+  {
+  public:
+    cardinality(solver &slv, std::vector<utils::lit> &&lits, std::size_t k, bool exact) noexcept;
+
+    std::vector<utils::var> scope() const noexcept override;
+    bool propagate(utils::var v) noexcept override;
+    std::unique_ptr<constraint> clone(solver &slv) const noexcept override;
+    std::size_t memory_usage() const noexcept override;
+
+    std::string to_string() const noexcept override;
+
+  private:
+    void update(std::size_t i) noexcept;
+    [[nodiscard]] bool assign_undefined(bool value) noexcept;
+    void undo(std::size_t change) noexcept override;
+
+  private:
+    const std::vector<utils::lit> lits;
+    const std::size_t k;                                                  // the maximum (or, if exact, the required) number of true literals
+    const bool exact;                                                     // whether exactly `k` literals must be true
+    std::unordered_map<utils::var, std::vector<std::size_t>> occurrences; // for each variable, the positions of its literals
+    std::vector<utils::lbool> vals;                                       // the values of the literals at the last update
+    std::size_t n_true = 0, n_false = 0;                                  // the number of true and false literals at the last update
+    std::size_t stamp;                                                    // the number of restorations at the last recount
+  };
+
+  class element final : public constraint
+  {
+  public:
+    element(solver &slv, utils::var y, utils::var x, const std::vector<std::pair<std::reference_wrapper<const utils::enum_val>, std::reference_wrapper<const utils::enum_val>>> &table) noexcept;
+
+    std::vector<utils::var> scope() const noexcept override;
+    bool propagate(utils::var v) noexcept override;
+    std::unique_ptr<constraint> clone(solver &slv) const noexcept override;
+    std::size_t memory_usage() const noexcept override;
+
+    std::string to_string() const noexcept override;
+
+  private:
+    /**
+     * @brief Forgets the value of index `i` in the universe of `x`, updating the supports.
+     */
+    void forget(std::size_t i) noexcept;
+    [[nodiscard]] bool remove_x(std::size_t i) noexcept;
+    void undo(std::size_t change) noexcept override;
+
+  private:
+    const utils::var y;
+    const utils::var x;
+    std::unordered_map<const utils::enum_val *, const utils::enum_val *> table;     // for each value of `x`, the value of `y`
+    std::unordered_map<const utils::enum_val *, std::vector<std::size_t>> preimage; // for each value of `y`, the indices, in the universe of `x`, of the values mapping to it
+    value_bitset known_x;                                                           // the domain of `x` at the last update, over its universe
+    std::unordered_map<const utils::enum_val *, std::size_t> supports;              // for each value of `y`, the number of values in `known_x` mapping to it
+    std::size_t stamp;                                                              // the number of restorations at the last recount
+  };
+
+  class global_cardinality final : public constraint
+  {
+  public:
+    global_cardinality(solver &slv, std::vector<utils::var> &&vars, const std::vector<std::tuple<std::reference_wrapper<const utils::enum_val>, std::size_t, std::size_t>> &bounds) noexcept;
+
+    std::vector<utils::var> scope() const noexcept override;
+    bool propagate(utils::var v) noexcept override;
+    std::unique_ptr<constraint> clone(solver &slv) const noexcept override;
+    std::size_t memory_usage() const noexcept override;
+
+    std::string to_string() const noexcept override;
+
+  private:
+    void update(std::size_t i) noexcept;
+    /**
+     * @brief Checks whether the value `val` was in the domain of the `i`-th variable at the last update.
+     */
+    [[nodiscard]] bool knows(std::size_t i, const utils::enum_val &val) const noexcept;
+    /**
+     * @brief Brings the `i`-th variable up to date, its wake-up being possibly pending, and checks whether it is no longer an unassigned variable which can take `val`.
+     */
+    [[nodiscard]] bool stale(std::size_t i, const utils::enum_val &val) noexcept;
+    void undo(std::size_t change) noexcept override;
+
+    struct counter
+    {
+      std::size_t lb, ub;        // the bounds on the number of variables taking the value
+      std::size_t n_assigned;    // the number of variables assigned to the value
+      std::size_t n_possible;    // the number of variables having the value in their domain
+    };
+
+  private:
+    const std::vector<utils::var> vars;
+    std::unordered_map<utils::var, std::vector<std::size_t>> occurrences; // for each variable, its positions in `vars`
+    std::unordered_map<const utils::enum_val *, counter> counters;        // the counters of the bounded values
+    std::vector<value_bitset> known;                                      // the domains of the variables at the last update, over their universes
+    std::vector<std::size_t> n_known;                                     // the number of values in each of `known`
+    std::size_t stride = 1;                                               // the size of the largest universe of the variables, for encoding the changes
+    std::size_t stamp;                                                    // the number of restorations at the last recount
+  };
 } // namespace arc_consistency
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace arc_consistency
+{
+  /**
+   * @brief A vector split into fixed-size pages, which are shared among its copies and copied on write.
+   *
+   * Copying a `cow_vector` costs one reference count increment per page. A page is copied the first time it is modified through a `cow_vector` that shares it.
+   *
+   * @tparam T The type of the elements.
+   * @tparam PageSize The number of elements in each page.
+   */
+  template <typename T, std::size_t PageSize = 256>
+  class cow_vector
+  {
+    using page = std::vector<T>;
+
+  public:
+    [[nodiscard]] std::size_t size() const noexcept { return n; }
+    [[nodiscard]] bool empty() const noexcept { return n == 0; }
+
+    [[nodiscard]] const T &operator[](std::size_t i) const noexcept
+    {
+      assert(i < n);
+      return (*pages[i / PageSize])[i % PageSize];
+    }
+    [[nodiscard]] const T &at(std::size_t i) const
+    {
+      if (i >= n)
+        throw std::out_of_range("cow_vector::at");
+      return (*this)[i];
+    }
+
+    /**
+     * @brief Gets a mutable reference to the `i`-th element, copying its page if it is shared.
+     */
+    [[nodiscard]] T &mut(std::size_t i) noexcept
+    {
+      assert(i < n);
+      return (*unique(pages[i / PageSize]))[i % PageSize];
+    }
+
+    /**
+     * @brief Gets whether the `i`-th element lies in a page shared with other copies.
+     */
+    [[nodiscard]] bool shared(std::size_t i) const noexcept
+    {
+      assert(i < n);
+      return pages[i / PageSize].use_count() > 1;
+    }
+    /**
+     * @brief Gets the number of bytes held by the pages, not counting what the elements allocate on their own.
+     */
+    [[nodiscard]] std::size_t memory_usage() const noexcept { return pages.capacity() * sizeof(std::shared_ptr<page>) + pages.size() * (sizeof(page) + PageSize * sizeof(T)); }
+
+    template <typename... Args>
+    void emplace_back(Args &&...args)
+    {
+      if (n % PageSize == 0)
+      {
+        pages.push_back(std::make_shared<page>());
+        pages.back()->reserve(PageSize);
+      }
+      unique(pages.back())->emplace_back(std::forward<Args>(args)...);
+      ++n;
+    }
+
+  private:
+    static std::shared_ptr<page> &unique(std::shared_ptr<page> &p)
+    {
+      if (p.use_count() > 1)
+      {
+        auto copy = std::make_shared<page>();
+        copy->reserve(PageSize);
+        copy->insert(copy->end(), p->begin(), p->end());
+        p = std::move(copy);
+      }
+      else // the other copies might have just released the page, so we synchronize with their last reads..
+        std::atomic_thread_fence(std::memory_order_acquire);
+      return p;
+    }
+
+  private:
+    std::vector<std::shared_ptr<page>> pages;
+    std::size_t n = 0;
+  };
+} // namespace arc_consistency
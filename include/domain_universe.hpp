@@ -0,0 +1,87 @@
+#pragma once
+
+#include "enum.hpp"
+#include "memory_usage.hpp"
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace arc_consistency
+{
+  [[nodiscard]] inline std::size_t lowest_bit(std::uint64_t word) noexcept
+  {
+    assert(word);
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward64(&idx, word);
+    return idx;
+#else
+    return static_cast<std::size_t>(__builtin_ctzll(word));
+#endif
+  }
+
+  /**
+   * @brief The ordered set of values shared by the variables created from the same value list.
+   *
+   * Each value is given a dense index, so that the domains of the variables sharing the universe can also be represented as bitsets.
+   */
+  class domain_universe final
+  {
+  public:
+    static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+    explicit domain_universe(const std::vector<std::reference_wrapper<const utils::enum_val>> &vals) noexcept;
+
+    [[nodiscard]] std::size_t size() const noexcept { return vals.size(); }
+    [[nodiscard]] const utils::enum_val &value(std::size_t i) const noexcept { return *vals[i]; }
+    [[nodiscard]] std::size_t index_of(const utils::enum_val &val) const noexcept
+    {
+      const auto it = indices.find(&val);
+      return it != indices.end() ? it->second : npos;
+    }
+    [[nodiscard]] std::size_t memory_usage() const noexcept { return sizeof(*this) + heap_bytes(vals) + heap_bytes(indices); }
+
+  private:
+    std::vector<const utils::enum_val *> vals;                       // the values, in index order
+    std::unordered_map<const utils::enum_val *, std::size_t> indices; // the index of each value
+  };
+
+  /**
+   * @brief A fixed-size set of value indices, stored as 64-bit words.
+   */
+  class value_bitset final
+  {
+  public:
+    value_bitset() noexcept = default;
+    explicit value_bitset(std::size_t n, bool full = false) noexcept;
+
+    [[nodiscard]] bool test(std::size_t i) const noexcept { return words[i / 64] & (std::uint64_t(1) << (i % 64)); }
+    void set(std::size_t i) noexcept { words[i / 64] |= std::uint64_t(1) << (i % 64); }
+    void reset(std::size_t i) noexcept { words[i / 64] &= ~(std::uint64_t(1) << (i % 64)); }
+    [[nodiscard]] std::size_t memory_usage() const noexcept { return heap_bytes(words); }
+
+    /**
+     * @brief Checks whether this bitset and the given one, having the same size, share at least one index.
+     */
+    [[nodiscard]] bool intersects(const value_bitset &other) const noexcept;
+    /**
+     * @brief Calls `f` with each index of this bitset not in the given one, having the same size.
+     */
+    template <typename F>
+    void for_each_difference(const value_bitset &other, F &&f) const noexcept
+    {
+      for (std::size_t w = 0; w < words.size(); ++w)
+        for (auto diff = words[w] & ~other.words[w]; diff; diff &= diff - 1)
+          f(w * 64 + lowest_bit(diff));
+    }
+
+  private:
+    std::vector<std::uint64_t> words;
+  };
+} // namespace arc_consistency
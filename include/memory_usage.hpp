@@ -0,0 +1,78 @@
+#pragma once
+
+#include <map>
+#include <queue>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace arc_consistency
+{
+  /**
+   * @brief Estimates the number of bytes allocated on the heap by a container, including what its elements allocate.
+   *
+   * The node-based containers are estimated assuming one node per element, holding the element and two pointers, plus one pointer per bucket.
+   */
+  template <typename T>
+  [[nodiscard]] std::size_t heap_bytes(const T &) noexcept { return 0; }
+  template <typename T0, typename T1>
+  [[nodiscard]] std::size_t heap_bytes(const std::pair<T0, T1> &p) noexcept;
+  template <typename T, typename A>
+  [[nodiscard]] std::size_t heap_bytes(const std::vector<T, A> &v) noexcept;
+  template <typename T, typename C>
+  [[nodiscard]] std::size_t heap_bytes(const std::queue<T, C> &q) noexcept;
+  template <typename K, typename C, typename A>
+  [[nodiscard]] std::size_t heap_bytes(const std::set<K, C, A> &s) noexcept;
+  template <typename K, typename V, typename C, typename A>
+  [[nodiscard]] std::size_t heap_bytes(const std::map<K, V, C, A> &m) noexcept;
+  template <typename K, typename H, typename E, typename A>
+  [[nodiscard]] std::size_t heap_bytes(const std::unordered_set<K, H, E, A> &s) noexcept;
+  template <typename K, typename V, typename H, typename E, typename A>
+  [[nodiscard]] std::size_t heap_bytes(const std::unordered_map<K, V, H, E, A> &m) noexcept;
+
+  template <typename T0, typename T1>
+  std::size_t heap_bytes(const std::pair<T0, T1> &p) noexcept { return heap_bytes(p.first) + heap_bytes(p.second); }
+  template <typename T, typename A>
+  std::size_t heap_bytes(const std::vector<T, A> &v) noexcept
+  {
+    std::size_t bytes = v.capacity() * sizeof(T);
+    for (const auto &e : v)
+      bytes += heap_bytes(e);
+    return bytes;
+  }
+  template <typename T, typename C>
+  std::size_t heap_bytes(const std::queue<T, C> &q) noexcept { return q.size() * sizeof(T); }
+  template <typename K, typename C, typename A>
+  std::size_t heap_bytes(const std::set<K, C, A> &s) noexcept
+  {
+    std::size_t bytes = s.size() * (sizeof(K) + 4 * sizeof(void *));
+    for (const auto &e : s)
+      bytes += heap_bytes(e);
+    return bytes;
+  }
+  template <typename K, typename V, typename C, typename A>
+  std::size_t heap_bytes(const std::map<K, V, C, A> &m) noexcept
+  {
+    std::size_t bytes = m.size() * (sizeof(std::pair<const K, V>) + 4 * sizeof(void *));
+    for (const auto &e : m)
+      bytes += heap_bytes(e);
+    return bytes;
+  }
+  template <typename K, typename H, typename E, typename A>
+  std::size_t heap_bytes(const std::unordered_set<K, H, E, A> &s) noexcept
+  {
+    std::size_t bytes = s.bucket_count() * sizeof(void *) + s.size() * (sizeof(K) + 2 * sizeof(void *));
+    for (const auto &e : s)
+      bytes += heap_bytes(e);
+    return bytes;
+  }
+  template <typename K, typename V, typename H, typename E, typename A>
+  std::size_t heap_bytes(const std::unordered_map<K, V, H, E, A> &m) noexcept
+  {
+    std::size_t bytes = m.bucket_count() * sizeof(void *) + m.size() * (sizeof(std::pair<const K, V>) + 2 * sizeof(void *));
+    for (const auto &e : m)
+      bytes += heap_bytes(e);
+    return bytes;
+  }
+} // namespace arc_consistency
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "arc_consistency.hpp"
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <thread>
+
+namespace arc_consistency
+{
+  /**
+   * @brief A portfolio of solvers, each searching a copy of the same problem with different parameters.
+   *
+   * The workers are forks of a base solver, which must outlive the portfolio. They run on separate threads and share the unit and binary nogoods they learn through lock-free rings, one for each worker, which the other workers read at their restarts. A worker never waits for the others: once its ring is full, its oldest nogoods are overwritten, and the workers which have not read them yet skip them. The first worker to complete its search stops the others.
+   */
+  class portfolio
+  {
+    static constexpr std::size_t max_shared_size = 2;  // the size of the longest nogood to be shared
+    static constexpr std::size_t ring_capacity = 1024; // the number of nogoods each worker keeps for the others
+    static constexpr std::size_t writing = std::numeric_limits<std::size_t>::max(); // the sequence number of a slot being written
+
+  public:
+    /**
+     * @brief Creates a portfolio of forks of the given solver, one for each search configuration.
+     *
+     * @param base The solver to fork.
+     * @param configs The search configurations of the workers.
+     */
+    portfolio(const solver &base, std::vector<search_options> &&configs) noexcept;
+    /**
+     * @brief Creates a portfolio of forks of the given solver, diversifying their heuristics and seeds.
+     *
+     * @param base The solver to fork.
+     * @param n_workers The number of workers.
+     */
+    portfolio(const solver &base, std::size_t n_workers = std::max(std::thread::hardware_concurrency(), 1u)) noexcept;
+
+    /**
+     * @brief Searches, in parallel, for an assignment of all the variables that satisfies the active constraints.
+     *
+     * @return true If a solution has been found by some worker.
+     * @return false If the active constraints are unsatisfiable.
+     */
+    [[nodiscard]] bool solve() noexcept;
+
+    /**
+     * @brief Gets the worker that completed the last search.
+     *
+     * If the search succeeded, the solution is in the domains of the variables of the returned solver.
+     *
+     * @return const solver& The worker that completed the last search.
+     */
+    [[nodiscard]] const solver &winner() const noexcept { return *workers.at(winner_idx); }
+
+    /**
+     * @brief Gets the number of shared nogoods which some worker skipped, during the last search, because they had been overwritten before it read them.
+     */
+    [[nodiscard]] std::size_t missed() const noexcept { return n_missed.load(std::memory_order_relaxed); }
+
+  private:
+    void share(std::size_t source, const clause &c) noexcept;
+    void import(std::size_t worker) noexcept;
+
+  private:
+    struct shared_nogood
+    { // written by a single worker, and read by the others only if its sequence number is the same before and after reading it
+      std::atomic<std::size_t> seq{0};                               // one plus the position of the nogood among those of its worker, or `writing`
+      std::atomic<std::size_t> size{0};                              // the number of literals of the nogood
+      std::array<std::atomic<std::size_t>, max_shared_size> lits{}; // the literals of the nogood, each as twice its variable plus its sign
+    };
+    struct nogood_ring
+    {
+      std::unique_ptr<shared_nogood[]> slots = std::make_unique<shared_nogood[]>(ring_capacity); // the last shared nogoods, each at its position modulo the capacity
+      std::atomic<std::size_t> published{0};                                                  // the number of nogoods shared so far
+    };
+
+    std::vector<search_options> configs;            // the search configuration of each worker
+    std::vector<std::unique_ptr<solver>> workers;   // the workers
+    std::vector<nogood_ring> rings;                 // for each worker, the nogoods it shares
+    std::vector<std::vector<std::size_t>> cursors; // for each worker, the number of nogoods it has gone through in each ring
+    std::atomic<std::size_t> n_missed{0};           // the number of shared nogoods skipped during the last search
+    std::atomic<bool> stop{false};                 // whether the workers should give up
+    std::size_t winner_idx = 0;                    // the worker that completed the last search
+  };
+} // namespace arc_consistency
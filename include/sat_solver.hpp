@@ -0,0 +1,218 @@
+#pragma once
+
+#include "arc_consistency.hpp"
+#include <cstdint>
+
+namespace arc_consistency
+{
+  class sat_solver;
+
+  /**
+   * @brief A constraint of a `sat_solver`, compiled into the clauses it stands for.
+   */
+  class sat_constraint final
+  {
+    friend class sat_solver;
+
+  public:
+    sat_constraint(std::vector<std::vector<utils::lit>> &&clauses) noexcept : clauses(std::move(clauses)) {}
+
+    [[nodiscard]] const std::vector<std::vector<utils::lit>> &get_clauses() const noexcept { return clauses; }
+    [[nodiscard]] bool is_active() const noexcept { return !ids.empty(); }
+
+    [[nodiscard]] std::string to_string() const noexcept;
+
+  private:
+    const std::vector<std::vector<utils::lit>> clauses; // the clauses the constraint stands for
+    std::vector<std::size_t> ids;                       // the indices of the clauses in the solver, while the constraint is active
+  };
+
+  /**
+   * @brief A solver for networks made only of boolean variables.
+   *
+   * It exposes the same constraint API as `solver`, restricted to the constraints over boolean variables, which are compiled into clauses, the cardinality constraints through sequential counters over auxiliary variables. The values of the variables are packed two bits each, and the clauses are propagated through literal-indexed watchlists, watching two literals per clause.
+   */
+  class sat_solver final
+  {
+  public:
+    sat_solver() noexcept;
+
+    /**
+     * @brief Creates and returns a new boolean variable.
+     *
+     * @return utils::var The index of the newly created variable.
+     */
+    [[nodiscard]] utils::var new_sat() noexcept;
+
+    /**
+     * @brief Returns the boolean value of a variable.
+     *
+     * @param x The variable.
+     * @return utils::lbool The value of the variable, or `utils::Undefined` if it is unassigned.
+     */
+    [[nodiscard]] utils::lbool sat_val(const utils::var &x) const noexcept;
+    /**
+     * @brief Returns the boolean value of a literal.
+     *
+     * @param l The literal.
+     * @return utils::lbool The value of the literal, or `utils::Undefined` if its variable is unassigned.
+     */
+    [[nodiscard]] utils::lbool sat_val(const utils::lit &l) const noexcept;
+
+    /**
+     * @brief Creates a new clause constraint.
+     *
+     * @param lits The literals of the clause.
+     * @return sat_constraint& A reference to the newly created clause constraint.
+     */
+    [[nodiscard]] sat_constraint &new_clause(std::vector<utils::lit> &&lits) noexcept;
+    /**
+     * @brief Creates a new equality constraint between two variables.
+     *
+     * @param x The first variable.
+     * @param y The second variable.
+     * @return sat_constraint& A reference to the newly created equality constraint.
+     */
+    [[nodiscard]] sat_constraint &new_equal(utils::var x, utils::var y) noexcept;
+    /**
+     * @brief Creates a new inequality constraint between two variables.
+     *
+     * @param x The first variable.
+     * @param y The second variable.
+     * @return sat_constraint& A reference to the newly created inequality constraint.
+     */
+    [[nodiscard]] sat_constraint &new_distinct(utils::var x, utils::var y) noexcept;
+    /**
+     * @brief Creates a new implication constraint.
+     *
+     * @param premise The premise variable.
+     * @param prem_val The value of the premise, either `solver::True` or `solver::False`.
+     * @param conclusion The conclusion variable.
+     * @param conc_val The value of the conclusion, either `solver::True` or `solver::False`.
+     * @return sat_constraint& A reference to the newly created implication constraint.
+     */
+    [[nodiscard]] sat_constraint &new_imply(utils::var premise, const utils::enum_val &prem_val, utils::var conclusion, const utils::enum_val &conc_val) noexcept;
+    /**
+     * @brief Creates a new assignment constraint.
+     *
+     * @param x The variable.
+     * @param val The value to be assigned, either `solver::True` or `solver::False`.
+     * @return sat_constraint& A reference to the newly created assignment constraint.
+     */
+    [[nodiscard]] sat_constraint &new_assign(utils::var x, const utils::enum_val &val) noexcept;
+    /**
+     * @brief Creates a new forbid constraint.
+     *
+     * @param x The variable.
+     * @param val The value to be forbidden, either `solver::True` or `solver::False`.
+     * @return sat_constraint& A reference to the newly created forbid constraint.
+     */
+    [[nodiscard]] sat_constraint &new_forbid(utils::var x, const utils::enum_val &val) noexcept;
+    /**
+     * @brief Creates a new at-most-k constraint.
+     *
+     * The constraint is compiled into the clauses of a sequential counter, over auxiliary variables created by this function.
+     *
+     * @param lits The literals to be counted.
+     * @param k The maximum number of true literals.
+     * @return sat_constraint& A reference to the newly created at-most-k constraint.
+     */
+    [[nodiscard]] sat_constraint &new_at_most(std::vector<utils::lit> &&lits, std::size_t k) noexcept;
+    /**
+     * @brief Creates a new exactly-k constraint.
+     *
+     * The constraint is compiled into two sequential counters, one bounding the true literals and one bounding the false ones, over auxiliary variables created by this function.
+     *
+     * @param lits The literals to be counted.
+     * @param k The number of true literals.
+     * @return sat_constraint& A reference to the newly created exactly-k constraint.
+     */
+    [[nodiscard]] sat_constraint &new_exactly(std::vector<utils::lit> &&lits, std::size_t k) noexcept;
+
+    /**
+     * @brief Adds a constraint to the solver.
+     *
+     * The clauses of the constraint are watched on their two best literals with respect to the root level assignment, so the constraint is propagated, incrementally, by the next call to `propagate`.
+     *
+     * @param c The constraint to be added.
+     */
+    void add_constraint(sat_constraint &c) noexcept;
+    /**
+     * @brief Retracts a constraint from the solver.
+     *
+     * All the variables are unassigned and the remaining clauses are watched again, so the next call to `propagate` computes the fixpoint from scratch.
+     *
+     * @param c The constraint to be retracted.
+     */
+    void retract(sat_constraint &c) noexcept;
+
+    /**
+     * @brief Propagates the clauses by unit propagation.
+     *
+     * @return true If no clause is falsified during propagation.
+     * @return false If a clause is falsified during propagation.
+     */
+    [[nodiscard]] bool propagate() noexcept;
+    /**
+     * @brief Searches for an assignment of all the variables that satisfies the active constraints.
+     *
+     * This function performs a depth-first search with chronological backtracking. If a solution is found, it remains in the values of the variables until the solver is next modified, or searched.
+     *
+     * @return true If a solution has been found.
+     * @return false If the active constraints are unsatisfiable.
+     */
+    [[nodiscard]] bool solve() noexcept;
+
+  private:
+    /**
+     * @brief Appends to `cls` the clauses stating that at most `k` of the literals `lits` are true, creating the auxiliary variables of the counter.
+     */
+    void at_most(const std::vector<utils::lit> &lits, std::size_t k, std::vector<std::vector<utils::lit>> &cls) noexcept;
+    [[nodiscard]] static std::size_t index(const utils::lit &l) noexcept { return utils::variable(l) * 2 + utils::sign(l); }
+    /**
+     * @brief Returns the two bits of the variable `v`: the higher bit tells whether it is assigned, the lower one its value.
+     */
+    [[nodiscard]] std::uint64_t bits(utils::var v) const noexcept { return (vals[v / 32] >> (2 * (v % 32))) & 3; }
+    /**
+     * @brief Makes the literal `l`, currently unassigned, true.
+     */
+    void assign(const utils::lit &l) noexcept;
+    /**
+     * @brief Watches the clause `id` on its two best literals, making it unit or conflicting if needed.
+     */
+    void watch(std::size_t id) noexcept;
+    /**
+     * @brief Unassigns the variables assigned after the first `size` entries of the trail.
+     */
+    void undo(std::size_t size) noexcept;
+    void backtrack_to_root() noexcept;
+
+  private:
+    struct sat_clause
+    {
+      std::vector<utils::lit> lits; // the literals, the first two being watched
+      bool active;                  // whether the clause belongs to an active constraint
+    };
+
+    std::size_t n_vars = 0;                              // the number of variables
+    std::vector<std::uint64_t> vals;                     // the values of the variables, two bits each
+    std::vector<sat_clause> clauses;                     // the clauses, including those of the retracted constraints until the next reset
+    std::vector<std::vector<std::size_t>> watches;       // for each literal, the clauses watching it
+    std::vector<std::unique_ptr<sat_constraint>> constraints; // the constraints created by this solver
+    std::vector<utils::lit> trail;                       // the literals made true, in order of assignment
+    std::size_t q_head = 0;                              // the position, in the trail, of the next literal to propagate
+    bool inconsistent = false;                           // whether a clause is falsified at the root level
+    struct decision
+    {
+      std::size_t size; // the size of the trail before the decision
+      utils::lit lit;   // the decided literal
+      bool refuted;     // whether the decided literal has been replaced by its negation
+    };
+    std::vector<decision> decisions; // the decisions of the search
+    std::size_t n_inactive = 0;      // the number of clauses of retracted constraints
+
+    friend std::string to_string(const sat_solver &s) noexcept;
+  };
+
+  [[nodiscard]] std::string to_string(const sat_solver &s) noexcept;
+} // namespace arc_consistency
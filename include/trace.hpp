@@ -0,0 +1,103 @@
+#pragma once
+
+#include "enum.hpp"
+#include "lit.hpp"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace arc_consistency
+{
+  class constraint;
+
+  /**
+   * @brief The kinds of events recorded by the trace of a solver.
+   */
+  enum class trace_kind : std::uint8_t
+  {
+    propagate, // a constraint is woken up by a change of the domain of a variable
+    remove,    // a value is removed from the domain of a variable
+    conflict,  // a constraint detects a conflict
+    retract,   // a constraint is retracted
+    refute,    // the search refutes a value of a variable, on backtracking
+    restart,   // the search restarts
+    learn,     // a nogood is learned from a conflict
+    import,    // a nogood is imported from another solver
+    prune      // the singleton arc consistency removes a value of a variable
+  };
+
+  /**
+   * @brief An event of the trace of a solver, recorded as is and formatted only when read.
+   */
+  struct trace_event
+  {
+    trace_kind kind;
+    utils::var var;             // the variable whose domain has changed, or is reduced, or the number of conflicts since the previous restart, for `restart` events
+    const utils::enum_val *val; // the removed value, for `remove`, `refute` and `prune` events
+    const constraint *c;        // the constraint woken up, responsible for the removal, detecting the conflict, or retracted (`nullptr` if it is a learned nogood)
+    std::size_t nogood;         // the sequence number of the learned nogood standing for `c`, as learned nogoods can be forgotten before the event is read (0 if none)
+  };
+
+  /**
+   * @brief A lock-free ring buffer of trace events, written by the thread running a solver and read by another one.
+   *
+   * When the buffer is full, the new events are dropped and counted, so that the solver never waits for the reader.
+   */
+  class trace_buffer final
+  {
+  public:
+    /**
+     * @brief Creates a buffer holding at least `capacity` events, rounded up to a power of two.
+     */
+    explicit trace_buffer(std::size_t capacity = 1 << 16) noexcept;
+
+    /**
+     * @brief Records an event, returning false if the buffer is full.
+     *
+     * Only the thread running the solver may call this function.
+     */
+    bool push(const trace_event &e) noexcept
+    {
+      const auto t = tail.load(std::memory_order_relaxed);
+      if (t - head.load(std::memory_order_acquire) == events.size())
+      {
+        n_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      events[t & mask] = e;
+      tail.store(t + 1, std::memory_order_release);
+      return true;
+    }
+
+    /**
+     * @brief Calls `f` with each recorded event, in order, and frees their slots, returning the number of events read.
+     *
+     * Only one thread at a time may call this function. The constraints referred to by the events must still be alive, which they are as long as the solver recording them is: the learned nogoods, freed along the search, are referred to by their sequence number only.
+     */
+    template <typename F>
+    std::size_t drain(F &&f)
+    {
+      const auto h = head.load(std::memory_order_relaxed);
+      const auto t = tail.load(std::memory_order_acquire);
+      for (auto i = h; i != t; ++i)
+        f(events[i & mask]);
+      head.store(t, std::memory_order_release);
+      return t - h;
+    }
+
+    /**
+     * @brief Gets the number of events dropped because the buffer was full.
+     */
+    [[nodiscard]] std::size_t dropped() const noexcept { return n_dropped.load(std::memory_order_relaxed); }
+
+  private:
+    std::vector<trace_event> events;               // the slots of the ring
+    const std::size_t mask;                        // the number of slots, minus one
+    alignas(64) std::atomic<std::size_t> head{0}; // the number of events read so far
+    alignas(64) std::atomic<std::size_t> tail{0}; // the number of events written so far
+    std::atomic<std::size_t> n_dropped{0};         // the number of events dropped so far
+  };
+
+  [[nodiscard]] std::string to_string(const trace_event &e) noexcept;
+} // namespace arc_consistency
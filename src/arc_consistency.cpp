@@ -1,6 +1,10 @@
 #include "arc_consistency.hpp"
 #include "logging.hpp"
 #include <algorithm>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <thread>
 #include <cassert>
 
 #ifdef ARCCONSISTENCY_ENABLE_LISTENERS
@@ -12,16 +16,70 @@
 #define FIRE_ON_DOMAIN_CHANGED(var)
 #endif
 
+#ifdef ARCCONSISTENCY_ENABLE_TRACE
+#define RECORD_EVENT(kind, var, val, c) \
+    if (tracer)                         \
+        tracer->push(make_event(trace_kind::kind, var, val, c));
+#else
+#define RECORD_EVENT(kind, var, val, c)
+#endif
+
 namespace arc_consistency
 {
     bool_val solver::True{true};
     bool_val solver::False{false};
 
-    solver::solver() noexcept
+    solver::solver() noexcept : active_constraints(std::make_shared<std::unordered_set<constraint *>>())
     {
         utils::var c_false = new_sat();
         assert(c_false == utils::FALSE_var);
-        dom.at(c_false).erase(&solver::True);
+        dom.mut(c_false).erase(&solver::True);
+    }
+
+    solver::solver(const solver &parent, fork_tag) noexcept : init_domain(parent.init_domain), dom(parent.dom), watchlist(parent.watchlist), universe_of(parent.universe_of), universes(parent.universes), bits(parent.bits), kept_bits(parent.kept_bits), active_constraints(parent.active_constraints), folded(parent.folded), detached(parent.detached), detached_watches(parent.detached_watches), last_removal(parent.dom.size(), no_removal), impacts(parent.impacts), inconsistent(parent.inconsistent), refuted(parent.refuted), activity_inc(parent.activity_inc)
+    {
+        if (parent.checkpoints.empty())
+        { // we inherit the pending propagations..
+            to_propagate.assign(parent.to_propagate.begin() + parent.q_head, parent.to_propagate.end());
+            for (const auto &[v, c] : parent.parked)
+                if (!parent.activity.count(c))
+                    parked.emplace_back(v, parent.origin(c));
+        }
+        else // we go back to the root level of the parent..
+            for (auto i = parent.trail.size(); i-- > parent.checkpoints.front();)
+            {
+                const auto v = parent.trail[i].var;
+                dom.mut(v).insert(parent.trail[i].val);
+                if (kept_bits[v])
+                    bits.mut(v).set(universes[v]->index_of(*parent.trail[i].val));
+            }
+    }
+
+    std::unique_ptr<solver> solver::fork() const noexcept { return std::unique_ptr<solver>(new solver(*this, fork_tag{})); }
+
+    constraint *solver::adopt(constraint *c) noexcept
+    {
+        auto &instance = adopted[c];
+        if (!instance)
+        {
+            instance = c->clone(*this);
+            origins.emplace(instance.get(), c);
+        }
+        return instance.get();
+    }
+
+    constraint *solver::origin(constraint *c) const noexcept
+    {
+        const auto it = origins.find(c);
+        return it != origins.end() ? it->second : c;
+    }
+
+    std::size_t solver::weight_of(const constraint *c) const noexcept
+    {
+        if (&c->slv == this)
+            return c->weight;
+        const auto it = adopted.find(c);
+        return it != adopted.end() ? it->second->weight : 1;
     }
 
     utils::var solver::new_var(const std::vector<std::reference_wrapper<const utils::enum_val>> &domain) noexcept
@@ -31,23 +89,34 @@ namespace arc_consistency
         for (const auto &ev_ref : domain)
             domain_set.emplace(&ev_ref.get());
         init_domain.emplace_back(std::move(domain_set));
-        dom.emplace_back(init_domain.back());
+        dom.emplace_back(init_domain[x]);
+        std::vector<const utils::enum_val *> vals;
+        vals.reserve(domain.size());
+        for (const auto &ev_ref : domain)
+            vals.push_back(&ev_ref.get());
+        auto &u = universe_of[vals];
+        if (!u) // the first variable with these values..
+            u = std::make_shared<const domain_universe>(domain);
+        universes.emplace_back(u);
+        bits.emplace_back(); // built on first read
+        kept_bits.push_back(false);
         watchlist.emplace_back();
+        impacts.emplace_back(0);
+        last_removal.push_back(no_removal);
         return x;
     }
 
-    utils::lbool solver::sat_val(const utils::var &x) const noexcept
+    static utils::lbool sat_val(const std::unordered_set<const utils::enum_val *> &var_dom) noexcept
     {
-        assert(x < dom.size());
-        if (dom[x].size() == 1)
-            return (*dom[x].begin() == &solver::True) ? utils::True : utils::False;
+        if (var_dom.size() == 1)
+            return (*var_dom.begin() == &solver::True) ? utils::True : utils::False;
         else
             return utils::Undefined; // variable is unassigned
     }
 
-    utils::lbool solver::sat_val(const utils::lit &l) const noexcept
+    static utils::lbool sat_val(utils::lbool var_val, const utils::lit &l) noexcept
     {
-        switch (sat_val(utils::variable(l)))
+        switch (var_val)
         {
         case utils::True:
             return utils::sign(l) ? utils::True : utils::False;
@@ -58,6 +127,17 @@ namespace arc_consistency
         }
     }
 
+    utils::lbool domain_snapshot::sat_val(const utils::var &x) const noexcept { return arc_consistency::sat_val(dom.at(x)); }
+    utils::lbool domain_snapshot::sat_val(const utils::lit &l) const noexcept { return arc_consistency::sat_val(sat_val(utils::variable(l)), l); }
+
+    utils::lbool solver::sat_val(const utils::var &x) const noexcept
+    {
+        assert(x < dom.size());
+        return arc_consistency::sat_val(dom[x]);
+    }
+
+    utils::lbool solver::sat_val(const utils::lit &l) const noexcept { return arc_consistency::sat_val(sat_val(utils::variable(l)), l); }
+
     constraint &solver::new_clause(std::vector<utils::lit> &&lits) noexcept
     {
         auto c = std::make_unique<clause>(*this, std::move(lits));
@@ -96,70 +176,757 @@ namespace arc_consistency
     }
     constraint &solver::new_forbid(utils::var x, const utils::enum_val &val) noexcept
     {
-        assert(init_domain.at(x).count(&val));
+        assert(universes.at(x)->index_of(val) != domain_universe::npos);
         auto c = std::make_unique<forbid>(*this, x, val);
         auto &ref = *c;
         constraints.emplace_back(std::move(c));
         return ref;
     }
 
+    constraint &solver::new_at_most(std::vector<utils::lit> &&lits, std::size_t k) noexcept
+    {
+        auto c = std::make_unique<cardinality>(*this, std::move(lits), k, false);
+        auto &ref = *c;
+        constraints.emplace_back(std::move(c));
+        return ref;
+    }
+    constraint &solver::new_exactly(std::vector<utils::lit> &&lits, std::size_t k) noexcept
+    {
+        auto c = std::make_unique<cardinality>(*this, std::move(lits), k, true);
+        auto &ref = *c;
+        constraints.emplace_back(std::move(c));
+        return ref;
+    }
+
+    constraint &solver::new_element(utils::var y, utils::var x, const std::vector<std::pair<std::reference_wrapper<const utils::enum_val>, std::reference_wrapper<const utils::enum_val>>> &table) noexcept
+    {
+        auto c = std::make_unique<element>(*this, y, x, table);
+        auto &ref = *c;
+        constraints.emplace_back(std::move(c));
+        return ref;
+    }
+    constraint &solver::new_gcc(std::vector<utils::var> &&vars, const std::vector<std::tuple<std::reference_wrapper<const utils::enum_val>, std::size_t, std::size_t>> &bounds) noexcept
+    {
+        auto c = std::make_unique<global_cardinality>(*this, std::move(vars), bounds);
+        auto &ref = *c;
+        constraints.emplace_back(std::move(c));
+        return ref;
+    }
+
     void solver::add_constraint(constraint &c) noexcept
     {
         LOG_TRACE("Adding " + c.to_string());
-        for (const auto &v : c.scope())
+        backtrack_to_root();
+        if (c.scope_vars.empty())
+            c.scope_vars = c.scope();
+        for (const auto &v : c.scope_vars)
         {
-            watchlist.at(v).emplace(&c);
-            to_propagate.emplace(v, nullptr);
+            watchlist.mut(v).emplace(&c);
+            to_propagate.emplace_back(v, nullptr);
         }
-        active_constraints.emplace(&c);
+        if (active_constraints.use_count() > 1)
+            active_constraints = std::make_shared<std::unordered_set<constraint *>>(*active_constraints);
+        active_constraints->emplace(&c);
     }
 
     void solver::retract(constraint &c) noexcept
     {
         LOG_TRACE("Retracting " + c.to_string());
+        RECORD_EVENT(retract, 0, nullptr, &c);
+        backtrack_to_root();
+        ++n_restorations;
+        if (const auto it = folded.find(&c); it != folded.end())
+        { // we give back the values the constraint has removed from the initial domain..
+            const auto v = it->second;
+            folded.erase(it);
+            refold(v);
+        }
+        if (const auto it = detached.find(&c); it != detached.end())
+        {
+            detached.erase(it);
+            for (const auto &v : c.scope())
+                detached_watches[v].erase(&c);
+        }
         std::unordered_set<utils::var> visited;
         std::queue<constraint *> to_restore;
+        const auto restore = [&](utils::var v)
+        {
+            dom.mut(v) = init_domain.at(v);
+            if (kept_bits[v])
+                bits.mut(v) = bits_of(v, init_domain[v]);
+            for (auto i = last_removal[v]; i != no_removal; i = trail[i].prev)
+            { // the removals from the variable are undone, so we clear them..
+                trail[i].val = nullptr;
+                trail[i].reason = nullptr;
+                trail[i].node = {};
+                ++n_cleared;
+            }
+            last_removal[v] = no_removal;
+            FIRE_ON_DOMAIN_CHANGED(v);
+            to_propagate.emplace_back(v, nullptr);
+            for (const auto &cc : watchlist.at(v))
+                to_restore.push(cc);
+            if (const auto it = detached_watches.find(v); it != detached_watches.end())
+                for (const auto &cc : it->second)
+                    to_restore.push(cc);
+        };
         to_restore.push(&c);
+        if (refuted || (inconsistent && !conflict))
+        { // the search might have refuted values of any variable, even unconstrained ones, because of a conflict elsewhere, so we restore them all..
+            for (utils::var v = utils::FALSE_var + 1; v < dom.size(); ++v) // the constant false is fixed outside its initial domain
+                if (visited.emplace(v).second)
+                    restore(v);
+            refuted = false;
+        }
+        else if (inconsistent) // the conflict might have emptied domains away from the retracted constraint..
+            to_restore.push(conflict);
+        inconsistent = false;
         while (!to_restore.empty())
         {
             const auto curr = to_restore.front();
             to_restore.pop();
             for (const auto &v : curr->scope())
                 if (visited.emplace(v).second)
+                    restore(v);
+        }
+        std::vector<constraint *> to_reattach; // the constraints standing for the detached ones might be gone..
+        for (const auto &[d, keeper] : detached)
+            if (keeper == &c || (!keeper && visited.count(d->scope().front())))
+                to_reattach.push_back(d);
+        for (const auto &d : to_reattach)
+            reattach(*d);
+        if (2 * n_cleared > trail.size())
+            compact_trail();
+        if (!learnts.empty())
+        { // the learned nogoods might depend on the retracted constraint..
+            std::unordered_set<const constraint *> forgotten;
+            for (const auto &l : learnts)
+                forgotten.insert(l.get());
+            forget_learnts(forgotten);
+        }
+        for (const auto &v : c.scope())
+            watchlist.mut(v).erase(&c);
+        parked.erase(std::remove_if(parked.begin(), parked.end(), [&c](const auto &w)
+                                    { return w.second == &c; }),
+                     parked.end());
+        if (active_constraints.use_count() > 1)
+            active_constraints = std::make_shared<std::unordered_set<constraint *>>(*active_constraints);
+        active_constraints->erase(&c);
+    }
+
+    propagation_status solver::propagate(std::size_t max_wakeups) noexcept
+    {
+        if (inconsistent)
+            return propagation_status::conflict; // the root level is inconsistent until a retraction
+        const auto wake = [this](utils::var v, constraint *c)
+        {
+            RECORD_EVENT(propagate, v, nullptr, c);
+            if (c->propagate(v))
+                return true;
+            RECORD_EVENT(conflict, v, nullptr, c);
+            conflict = c;
+            ++c->weight;
+            inconsistent |= checkpoints.empty();
+            return false;
+        };
+        while (!parked.empty())
+        { // we resume the wake-ups interrupted by the last suspension..
+            if (max_wakeups == 0)
+                return propagation_status::suspended;
+            --max_wakeups;
+            const auto [v, w] = parked.back();
+            parked.pop_back();
+            if (!wake(v, resolve(w)))
+                return propagation_status::conflict; // Conflict detected
+        }
+        static const std::vector<constraint *> no_learnts;
+        while (q_head < to_propagate.size())
+        {
+            const auto [v, r] = to_propagate[q_head++];
+            auto &watches = watchlist.at(v);
+            auto &learnt_ws = v < learnt_watches.size() ? learnt_watches[v] : no_learnts;
+            for (auto it = watches.begin(); it != watches.end(); ++it)
+                if (const auto c = resolve(*it); c != r)
+                {
+                    if (max_wakeups == 0)
+                    { // we park the remaining wake-ups of `v` for the next call..
+                        for (; it != watches.end(); ++it)
+                            if (resolve(*it) != r)
+                                parked.emplace_back(v, *it);
+                        for (const auto &l : learnt_ws)
+                            if (l != r)
+                                parked.emplace_back(v, l);
+                        std::reverse(parked.begin(), parked.end());
+                        return propagation_status::suspended;
+                    }
+                    --max_wakeups;
+                    if (!wake(v, c))
+                        return propagation_status::conflict; // Conflict detected
+                }
+            for (auto it = learnt_ws.begin(); it != learnt_ws.end(); ++it)
+                if (*it != r)
                 {
-                    dom.at(v) = init_domain.at(v);
-                    FIRE_ON_DOMAIN_CHANGED(v);
-                    to_propagate.emplace(v, nullptr);
-                    for (const auto &cc : watchlist.at(v))
-                        to_restore.push(cc);
+                    if (max_wakeups == 0)
+                    { // ..along with those of the learned nogoods
+                        for (; it != learnt_ws.end(); ++it)
+                            if (*it != r)
+                                parked.emplace_back(v, *it);
+                        std::reverse(parked.begin(), parked.end());
+                        return propagation_status::suspended;
+                    }
+                    --max_wakeups;
+                    if (!wake(v, *it))
+                        return propagation_status::conflict; // Conflict detected
                 }
         }
-        for (const auto &v : c.scope())
-            watchlist.at(v).erase(&c);
-        active_constraints.erase(&c);
+        to_propagate.clear(); // we keep the capacity for the next propagation
+        q_head = 0;
+        return propagation_status::fixpoint;
     }
 
-    bool solver::propagate() noexcept
+    bool solver::singleton_propagate(std::size_t n_workers) noexcept
     {
-        while (!to_propagate.empty())
+        backtrack_to_root();
+        if (!propagate())
+            return false;
+        if (n_workers > 1)
+            return parallel_singleton_propagate(n_workers);
+        std::vector<const utils::enum_val *> vals;
+        bool changed = true;
+        while (changed)
         {
-            const auto [v, r] = to_propagate.front();
-            to_propagate.pop();
-            for (const auto &c : watchlist.at(v))
-                if (c != r)
+            changed = false;
+            for (utils::var x = 0; x < dom.size(); ++x)
+                if (dom[x].size() > 1)
                 {
-                    LOG_TRACE("Propagating " + c->to_string());
-                    if (!c->propagate(v))
-                        return false; // Conflict detected
+                    vals.assign(dom[x].begin(), dom[x].end());
+                    for (const auto &val : vals)
+                    {
+                        if (!dom[x].count(val))
+                            continue; // the value has been removed by a previous probe
+                        push();
+                        const bool consistent = decide(x, *val) && propagate();
+                        pop();
+                        if (!consistent)
+                        { // `x = val` leads to a conflict, so we remove `val` from the domain of `x`..
+                            RECORD_EVENT(prune, x, val, nullptr);
+                            if (!remove(x, *val, nullptr) || !propagate())
+                                return false;
+                            changed = true;
+                        }
+                    }
                 }
         }
         return true;
     }
 
+    bool solver::parallel_singleton_propagate(std::size_t n_workers) noexcept
+    {
+        std::vector<std::pair<utils::var, const utils::enum_val *>> probes;
+        while (true)
+        {
+            probes.clear();
+            for (utils::var x = 0; x < dom.size(); ++x)
+                if (dom[x].size() > 1)
+                    for (const auto &val : dom[x])
+                        probes.emplace_back(x, val);
+            // each fork probes its share of the values against the current domains..
+            const auto n = std::min(n_workers, probes.size());
+            std::vector<std::unique_ptr<solver>> forks;
+            forks.reserve(n);
+            for (std::size_t i = 0; i < n; ++i)
+                forks.push_back(fork());
+            std::vector<std::vector<std::pair<utils::var, const utils::enum_val *>>> failed(n);
+            std::vector<std::thread> threads;
+            threads.reserve(n);
+            for (std::size_t i = 0; i < n; ++i)
+                threads.emplace_back([i, n, &probes, &forks, &failed]
+                                     {
+                                         auto &f = *forks[i];
+                                         for (auto j = i; j < probes.size(); j += n)
+                                         {
+                                             f.push();
+                                             const bool consistent = f.decide(probes[j].first, *probes[j].second) && f.propagate();
+                                             f.pop();
+                                             if (!consistent)
+                                                 failed[i].push_back(probes[j]);
+                                         } });
+            for (auto &t : threads)
+                t.join();
+            forks.clear(); // so that the removals do not copy the pages shared with the forks
+
+            // ..and the failed probes are removed here, before probing again the values left
+            bool changed = false;
+            for (const auto &f : failed)
+                for (const auto &[x, val] : f)
+                    if (dom[x].count(val))
+                    {
+                        RECORD_EVENT(prune, x, val, nullptr);
+                        if (!remove(x, *val, nullptr) || !propagate())
+                            return false;
+                        changed = true;
+                    }
+            if (!changed)
+                return true;
+        }
+    }
+
+    /**
+     * @brief Returns the `i`-th element (starting from 0) of the Luby sequence.
+     */
+    static std::size_t luby(std::size_t i) noexcept
+    {
+        std::size_t size = 1, seq = 0;
+        while (size < i + 1)
+        {
+            ++seq;
+            size = 2 * size + 1;
+        }
+        while (size - 1 != i)
+        {
+            size = (size - 1) >> 1;
+            --seq;
+            i = i % size;
+        }
+        return std::size_t(1) << seq;
+    }
+
+    /**
+     * @brief Restricts `vals` according to the constraint `c`, if it is an `assign` or a `forbid`, returning its variable.
+     */
+    static std::optional<utils::var> fold(const constraint &c, std::unordered_set<const utils::enum_val *> &vals) noexcept
+    {
+        if (const auto a = dynamic_cast<const assign *>(&c))
+        {
+            for (auto it = vals.begin(); it != vals.end();)
+                if (*it != &a->get_val())
+                    it = vals.erase(it);
+                else
+                    ++it;
+            return a->get_var();
+        }
+        if (const auto f = dynamic_cast<const forbid *>(&c))
+        {
+            vals.erase(&f->get_val());
+            return f->get_var();
+        }
+        return std::nullopt;
+    }
+
+    presolve_report solver::presolve() noexcept
+    {
+        LOG_TRACE("Presolving");
+        backtrack_to_root();
+        presolve_report report;
+        std::vector<constraint *> candidates;
+        for (const auto &c : *active_constraints)
+            if (!folded.count(c) && !detached.count(c))
+                candidates.push_back(c);
+
+        // we apply the unary constraints to the initial domains..
+        std::vector<constraint *> remaining;
+        for (const auto &c : candidates)
+        {
+            const auto scope = c->scope();
+            std::unordered_set<const utils::enum_val *> var_dom;
+            std::optional<utils::var> v;
+            if (scope.size() == 1)
+            {
+                var_dom = dom[scope.front()];
+                v = fold(*c, var_dom);
+            }
+            if (!v || var_dom.empty())
+            { // not a unary constraint, or one which would empty the domain
+                remaining.push_back(c);
+                continue;
+            }
+            auto &var_init = init_domain.mut(*v);
+            fold(*c, var_init);
+            if (var_dom.size() != dom[*v].size())
+            {
+                dom.mut(*v) = std::move(var_dom);
+                if (kept_bits[*v])
+                    bits.mut(*v) = bits_of(*v, dom[*v]);
+                FIRE_ON_DOMAIN_CHANGED(*v);
+                to_propagate.emplace_back(*v, nullptr);
+            }
+            watchlist.mut(*v).erase(c);
+            folded.emplace(c, *v);
+            ++report.folded;
+        }
+        parked.erase(std::remove_if(parked.begin(), parked.end(), [this](const auto &w)
+                                    { return folded.count(w.second); }),
+                     parked.end());
+
+        // we set aside the duplicate pairwise constraints..
+        std::map<std::tuple<bool, utils::var, utils::var>, constraint *> pairs;
+        std::vector<std::pair<constraint *, std::vector<std::size_t>>> clauses; // the clauses, with their sorted literal codes
+        candidates.clear();
+        for (const auto &c : remaining)
+            if (dynamic_cast<const eq *>(c) || dynamic_cast<const neq *>(c))
+            {
+                const auto scope = c->scope();
+                if (const auto [it, inserted] = pairs.emplace(std::make_tuple(dynamic_cast<const eq *>(c) != nullptr, std::min(scope[0], scope[1]), std::max(scope[0], scope[1])), c); !inserted)
+                {
+                    detach(*c, it->second);
+                    ++report.duplicates;
+                }
+                else
+                    candidates.push_back(c);
+            }
+            else if (const auto cl = dynamic_cast<const clause *>(c); cl && !cl->get_lits().empty())
+            {
+                std::vector<std::size_t> codes;
+                codes.reserve(cl->get_lits().size());
+                for (const auto &l : cl->get_lits())
+                    codes.push_back(utils::variable(l) * 2 + utils::sign(l));
+                std::sort(codes.begin(), codes.end());
+                codes.erase(std::unique(codes.begin(), codes.end()), codes.end());
+                clauses.emplace_back(c, std::move(codes));
+            }
+            else
+                candidates.push_back(c);
+
+        // ..and the clauses subsumed by shorter, or identical, ones
+        std::stable_sort(clauses.begin(), clauses.end(), [](const auto &lhs, const auto &rhs)
+                         { return lhs.second.size() < rhs.second.size(); });
+        std::unordered_map<std::size_t, std::vector<std::size_t>> firsts; // for each literal code, the kept clauses starting with it
+        for (std::size_t i = 0; i < clauses.size(); ++i)
+        {
+            const auto &[c, codes] = clauses[i];
+            const auto subsumes = [&clauses, &codes = codes](const auto &j)
+            { return std::includes(codes.begin(), codes.end(), clauses[j].second.begin(), clauses[j].second.end()); };
+            std::optional<std::size_t> keeper;
+            for (auto it = codes.begin(); !keeper && it != codes.end(); ++it)
+                if (const auto at_code = firsts.find(*it); at_code != firsts.end())
+                    if (const auto j = std::find_if(at_code->second.begin(), at_code->second.end(), subsumes); j != at_code->second.end())
+                        keeper = *j;
+            if (keeper)
+            {
+                if (clauses[*keeper].second.size() == codes.size())
+                    ++report.duplicates;
+                else
+                    ++report.subsumed;
+                detach(*c, clauses[*keeper].first);
+            }
+            else
+            {
+                firsts[codes.front()].push_back(i);
+                candidates.push_back(c);
+            }
+        }
+
+        // we set aside the constraints whose variables are all fixed, if they have all been propagated..
+        if (q_head == to_propagate.size() && parked.empty())
+            for (const auto &c : candidates)
+            {
+                const auto scope = c->scope();
+                if (!scope.empty() && std::all_of(scope.begin(), scope.end(), [this](const auto &v)
+                                                  { return dom[v].size() == 1; }))
+                {
+                    detach(*c, nullptr);
+                    ++report.entailed;
+                }
+            }
+        return report;
+    }
+
+    void solver::refold(utils::var v) noexcept
+    {
+        std::unordered_set<const utils::enum_val *> vals;
+        for (std::size_t i = 0; i < universes[v]->size(); ++i)
+            vals.insert(&universes[v]->value(i));
+        for (const auto &[c, fv] : folded)
+            if (fv == v)
+                fold(*c, vals);
+        init_domain.mut(v) = std::move(vals);
+    }
+
+    void solver::detach(constraint &c, constraint *keeper) noexcept
+    {
+        for (const auto &v : c.scope())
+        {
+            watchlist.mut(v).erase(&c);
+            detached_watches[v].insert(&c);
+        }
+        parked.erase(std::remove_if(parked.begin(), parked.end(), [&c](const auto &w)
+                                    { return w.second == &c; }),
+                     parked.end());
+        detached.emplace(&c, keeper);
+    }
+
+    void solver::reattach(constraint &c) noexcept
+    {
+        detached.erase(&c);
+        for (const auto &v : c.scope())
+        {
+            detached_watches[v].erase(&c);
+            watchlist.mut(v).emplace(&c);
+            to_propagate.emplace_back(v, nullptr);
+        }
+    }
+
+    bool solver::solve(const search_options &opts) noexcept
+    {
+        backtrack_to_root();
+        if (!propagate())
+            return false;
+        decisions.reserve(dom.size());
+        std::size_t n_vals = 0;
+        for (utils::var x = 0; x < dom.size(); ++x)
+            n_vals += dom[x].size();
+        trail.reserve(n_vals);
+        std::size_t n_restarts = 0, n_conflicts = 0, conflict_limit = luby(n_restarts) * opts.restart_base;
+        std::minstd_rand rng(opts.seed);
+        bool decided = false;
+        while (true)
+        {
+            if (propagate())
+            {
+                if (decided) // we update the impact of the last decision..
+                    impacts.mut(decisions.back().first) = .75 * impacts[decisions.back().first] + .25 * static_cast<double>(trail.size() - checkpoints.back());
+                if (stop && stop->load(std::memory_order_relaxed))
+                    return false; // the search has been stopped from outside
+                const auto x = select_var(opts.heuristic);
+                if (x == utils::FALSE_var)
+                    return true; // all the variables are assigned
+                auto val = dom[x].begin();
+                if (opts.seed)
+                    std::advance(val, rng() % dom[x].size());
+                push();
+                decisions.emplace_back(x, *val);
+                decided = decide(x, *decisions.back().second);
+                assert(decided);
+                continue;
+            }
+            decided = false;
+            while (true)
+            { // we backtrack, refuting the most recent decisions, until the conflict is solved..
+                ++n_conflicts;
+                if (decisions.empty())
+                    return false; // the conflict does not depend on any decision
+                clause *learnt = nullptr;
+                if (opts.learning)
+                {
+                    const auto expl = explain_conflict();
+                    if (expl.assumptions.empty())
+                    { // the conflict does not depend on any decision
+                        backtrack_to_root();
+                        inconsistent = true;
+                        return false;
+                    }
+                    learnt = learn(expl, opts.max_nogood_size);
+                    if (learnt && on_learnt)
+                        on_learnt(*learnt);
+                }
+                const auto [x, val] = decisions.back();
+                impacts.mut(x) = .75 * impacts[x] + .25 * static_cast<double>(trail.size() - checkpoints.back());
+                decisions.pop_back();
+                pop();
+                if (learnt && learnt->get_lits().size() == 1)
+                { // a unit nogood holds at the root level, where it keeps pruning across the restarts..
+                    backtrack_to_root();
+                    activate_learnt(*learnt);
+                    if (learnts.size() > opts.max_learnts)
+                        reduce_learnts();
+                    if (!propagate())
+                        return false; // the root level is inconsistent
+                    break;
+                }
+                if (learnt)
+                { // the learned nogood might already refute the decision, or even falsify the parent level..
+                    activate_learnt(*learnt);
+                    if (learnts.size() > opts.max_learnts)
+                        reduce_learnts();
+                    if (!propagate())
+                        continue;
+                    if (!dom[x].count(val))
+                        break;
+                }
+                RECORD_EVENT(refute, x, val, nullptr);
+                refuted |= checkpoints.empty();
+                if (remove(x, *val, nullptr) && propagate())
+                    break;
+            }
+            if (opts.restarts && n_conflicts >= conflict_limit)
+            { // we restart the search, keeping the learned weights and impacts..
+                RECORD_EVENT(restart, n_conflicts, nullptr, nullptr);
+                backtrack_to_root();
+                if (on_restart)
+                    on_restart();
+                n_conflicts = 0;
+                conflict_limit = luby(++n_restarts) * opts.restart_base;
+            }
+        }
+    }
+
+    explanation solver::explain_conflict() const noexcept
+    {
+        explanation expl;
+        std::vector<bool> marked(dom.size(), false);
+        std::unordered_set<const constraint *> seen;
+        if (conflict)
+        {
+            seen.insert(conflict);
+            expl.constraints.push_back(origin(conflict));
+            for (const auto &v : conflict->scope())
+                marked[v] = true;
+        }
+        else if (!trail.empty()) // the conflict is due to a removal not imposed by any constraint..
+            marked[trail.back().var] = true;
+        const auto root_size = checkpoints.empty() ? trail.size() : checkpoints.front();
+        for (auto i = trail.size(); i-- > 0;)
+            if (marked[trail[i].var])
+            {
+                if (const auto r = trail[i].reason)
+                {
+                    if (seen.insert(r).second)
+                    {
+                        expl.constraints.push_back(origin(r));
+                        for (const auto &v : r->scope())
+                            marked[v] = true;
+                    }
+                }
+                else if (i >= root_size) // removals at the root level without a reason are consequences of the constraints..
+                    expl.assumptions.emplace_back(trail[i].var, trail[i].val);
+            }
+        return expl;
+    }
+
+    clause *solver::learn(const explanation &expl, std::size_t max_size) noexcept
+    {
+        for (const auto &c : expl.constraints)
+            if (const auto it = activity.find(c); it != activity.end())
+                it->second += activity_inc;
+        if ((activity_inc /= .999) > 1e100)
+        { // we rescale the activities..
+            for (auto &[c, a] : activity)
+                a *= 1e-100;
+            activity_inc *= 1e-100;
+        }
+
+        if (expl.assumptions.size() > max_size)
+            return nullptr;
+        std::vector<utils::lit> lits;
+        lits.reserve(expl.assumptions.size());
+        for (const auto &[x, val] : expl.assumptions)
+        {
+            if (init_domain[x].size() != 2 || (val != &solver::True && val != &solver::False))
+                return nullptr; // not a SAT variable
+            lits.emplace_back(x, val == &solver::True);
+        }
+        learnts.push_back(std::make_unique<clause>(*this, std::move(lits)));
+#ifdef ARCCONSISTENCY_ENABLE_TRACE
+        nogood_ids.emplace(learnts.back().get(), ++n_nogoods);
+#endif
+        RECORD_EVENT(learn, 0, nullptr, learnts.back().get());
+        return learnts.back().get();
+    }
+
+    void solver::activate_learnt(clause &c) noexcept
+    {
+        c.scope_vars = c.scope();
+        if (learnt_watches.size() < dom.size())
+            learnt_watches.resize(dom.size());
+        for (const auto &v : c.scope_vars)
+        {
+            learnt_watches[v].push_back(&c);
+            to_propagate.emplace_back(v, nullptr);
+        }
+        activity[&c] = activity_inc;
+    }
+
+    void solver::import_nogood(std::vector<utils::lit> &&lits) noexcept
+    {
+        refuted = true; // the nogood might follow from the refutations of another solver..
+        learnts.push_back(std::make_unique<clause>(*this, std::move(lits)));
+#ifdef ARCCONSISTENCY_ENABLE_TRACE
+        nogood_ids.emplace(learnts.back().get(), ++n_nogoods);
+#endif
+        RECORD_EVENT(import, 0, nullptr, learnts.back().get());
+        activate_learnt(*learnts.back());
+    }
+
+    void solver::reduce_learnts() noexcept
+    {
+        std::vector<const constraint *> by_activity;
+        by_activity.reserve(learnts.size());
+        for (const auto &l : learnts)
+            by_activity.push_back(l.get());
+        const auto half = by_activity.begin() + by_activity.size() / 2;
+        std::nth_element(by_activity.begin(), half, by_activity.end(), [this](const constraint *a, const constraint *b)
+                         { return activity.at(a) < activity.at(b); });
+        forget_learnts(std::unordered_set<const constraint *>(by_activity.begin(), half));
+    }
+
+    void solver::forget_learnts(const std::unordered_set<const constraint *> &forgotten) noexcept
+    {
+        for (const auto &c : forgotten)
+        {
+            for (const auto &v : c->scope())
+            {
+                auto &ws = learnt_watches[v];
+                ws.erase(std::remove(ws.begin(), ws.end(), c), ws.end());
+            }
+            activity.erase(c);
+#ifdef ARCCONSISTENCY_ENABLE_TRACE
+            nogood_ids.erase(c);
+#endif
+        }
+        for (const auto &c : forgotten) // the learned nogoods are consequences of the constraints, so their removals can stay..
+            for (const auto &v : c->scope())
+                for (auto i = last_removal[v]; i != no_removal; i = trail[i].prev)
+                    if (trail[i].reason == c)
+                        trail[i].reason = nullptr;
+        if (forgotten.count(conflict))
+            conflict = nullptr;
+        parked.erase(std::remove_if(parked.begin(), parked.end(), [&forgotten](const auto &w)
+                                    { return forgotten.count(w.second); }),
+                     parked.end());
+        learnts.erase(std::remove_if(learnts.begin(), learnts.end(), [&forgotten](const auto &l)
+                                     { return forgotten.count(l.get()); }),
+                      learnts.end());
+    }
+
+    utils::var solver::select_var(var_heuristic h) const noexcept
+    {
+        utils::var best = utils::FALSE_var;
+        double best_score = std::numeric_limits<double>::infinity();
+        for (utils::var x = 0; x < dom.size(); ++x)
+            if (dom[x].size() > 1)
+            {
+                double score = static_cast<double>(dom[x].size());
+                switch (h)
+                {
+                case var_heuristic::dom_wdeg:
+                    score /= std::accumulate(watchlist[x].begin(), watchlist[x].end(), 0.0, [this, x](double acc, const constraint *c)
+                                             { return std::any_of(c->scope_vars.begin(), c->scope_vars.end(), [this, x](utils::var v)
+                                                                  { return v != x && dom[v].size() > 1; }) // only the constraints which can still be falsified by a future decision count..
+                                                          ? acc + weight_of(c)
+                                                          : acc; }) +
+                             1;
+                    break;
+                case var_heuristic::impact:
+                    score /= impacts[x] + 1;
+                    break;
+                default:
+                    break;
+                }
+                if (score < best_score)
+                {
+                    best = x;
+                    best_score = score;
+                }
+            }
+        return best;
+    }
+
     bool solver::match(const utils::lit &l0, const utils::lit &l1) const noexcept { return utils::sign(l0) == utils::sign(l1) ? match(utils::variable(l0), utils::variable(l1)) : !match(utils::variable(l0), utils::variable(l1)); }
 
     bool solver::match(const utils::var v0, const utils::var v1) const noexcept
     {
+        if (universes.at(v0) == universes.at(v1) && kept_bits[v0] && kept_bits[v1])
+            return bits[v0].intersects(bits[v1]);
         for (auto *val0 : dom.at(v0))
             if (dom.at(v1).count(val0))
                 return true;
@@ -168,18 +935,222 @@ namespace arc_consistency
 
     bool solver::allows(utils::var v, const utils::enum_val &val) const noexcept { return dom.at(v).count(&val); }
 
-    bool solver::remove(utils::var v, const utils::enum_val &val, constraint &c) noexcept
+    const value_bitset &solver::bits_in_step(utils::var v) noexcept
     {
-        assert(dom.at(v).find(&val) != dom.at(v).end());
-        dom.at(v).erase(&val);
+        if (!kept_bits[v])
+        { // from now on, the bitset follows the removals and their undoing..
+            bits.mut(v) = bits_of(v, dom[v]);
+            kept_bits[v] = true;
+        }
+        return bits[v];
+    }
+
+    value_bitset solver::bits_of(utils::var v, const std::unordered_set<const utils::enum_val *> &vals) const noexcept
+    {
+        const auto &u = *universes[v];
+        value_bitset res(u.size());
+        for (const auto &val : vals)
+            res.set(u.index_of(*val));
+        return res;
+    }
+
+    bool solver::remove(utils::var v, const utils::enum_val &val, constraint *c) noexcept
+    {
+        auto &var_dom = dom.mut(v);
+        assert(var_dom.find(&val) != var_dom.end());
+        trail.push_back({v, &val, c, var_dom.extract(&val), last_removal[v]}); // we keep the node, so that backtracking does not allocate
+        last_removal[v] = trail.size() - 1;
+        if (kept_bits[v])
+            bits.mut(v).reset(universes[v]->index_of(val));
+        RECORD_EVENT(remove, v, &val, c);
         FIRE_ON_DOMAIN_CHANGED(v);
-        if (dom.at(v).empty())
+        if (var_dom.empty())
+        {
+            conflict = c;
+            inconsistent |= checkpoints.empty();
             return false;
-        LOG_TRACE(to_string(*this, v));
-        to_propagate.emplace(v, &c);
+        }
+        to_propagate.emplace_back(v, c);
         return true;
     }
 
+    bool solver::decide(utils::var v, const utils::enum_val &val) noexcept
+    {
+        auto &var_dom = dom.mut(v);
+        if (!var_dom.count(&val))
+            return false;
+        while (var_dom.size() > 1)
+        {
+            auto it = var_dom.begin();
+            if (*it == &val)
+                ++it;
+            if (!remove(v, **it, nullptr))
+                return false;
+        }
+        return true;
+    }
+
+    void solver::push() noexcept
+    {
+        checkpoints.push_back(trail.size());
+        undo_marks.push_back(undos.size());
+    }
+
+    void solver::pop() noexcept
+    {
+        assert(!checkpoints.empty());
+        while (trail.size() > checkpoints.back())
+        {
+            auto &r = trail.back();
+            const auto v = r.var;
+            if (kept_bits[v])
+                bits.mut(v).set(universes[v]->index_of(*r.val));
+            dom.mut(v).insert(std::move(r.node));
+            last_removal[v] = r.prev;
+            trail.pop_back();
+            FIRE_ON_DOMAIN_CHANGED(v);
+        }
+        checkpoints.pop_back();
+        while (undos.size() > undo_marks.back())
+        { // the constraints go back to their state at the checkpoint..
+            const auto [c, change] = undos.back();
+            undos.pop_back();
+            c->undo(change);
+        }
+        undo_marks.pop_back();
+        to_propagate.clear();
+        q_head = 0;
+        parked.clear();
+    }
+
+    void solver::compact_trail() noexcept
+    {
+        assert(checkpoints.empty());
+        trail.erase(std::remove_if(trail.begin(), trail.end(), [](const auto &r)
+                                   { return !r.val; }),
+                    trail.end());
+        std::fill(last_removal.begin(), last_removal.end(), no_removal);
+        for (std::size_t i = 0; i < trail.size(); ++i)
+        {
+            trail[i].prev = last_removal[trail[i].var];
+            last_removal[trail[i].var] = i;
+        }
+        n_cleared = 0;
+    }
+
+    void solver::backtrack_to_root() noexcept
+    {
+        while (!checkpoints.empty())
+            pop();
+        decisions.clear();
+    }
+
+    std::size_t solver::publish() noexcept
+    {
+        std::atomic_store(&published, std::shared_ptr<const domain_snapshot>(std::make_shared<domain_snapshot>(++n_published, dom)));
+        return n_published;
+    }
+
+#ifdef ARCCONSISTENCY_ENABLE_TRACE
+    trace_event solver::make_event(trace_kind kind, utils::var var, const utils::enum_val *val, const constraint *c) const noexcept
+    {
+        if (!nogood_ids.empty())
+            if (const auto it = nogood_ids.find(c); it != nogood_ids.end())
+                return {kind, var, val, nullptr, it->second};
+        return {kind, var, val, c, 0};
+    }
+#endif
+
+    std::size_t memory_report::total() const noexcept
+    {
+        std::size_t bytes = domains + init_domains + watchlists + learnts + queue + search + listeners + other;
+        for (const auto &[type, c_bytes] : constraints)
+            bytes += c_bytes;
+        return bytes;
+    }
+
+    memory_report solver::memory_usage() const noexcept
+    {
+        memory_report report;
+        report.domains = dom.memory_usage() + bits.memory_usage();
+        for (utils::var v = 0; v < dom.size(); ++v)
+            report.domains += heap_bytes(dom[v]) + bits[v].memory_usage();
+        report.domains += kept_bits.capacity() / 8; // one bit per variable
+        report.init_domains = init_domain.memory_usage();
+        for (utils::var v = 0; v < init_domain.size(); ++v)
+            report.init_domains += heap_bytes(init_domain[v]);
+        report.watchlists = watchlist.memory_usage();
+        for (utils::var v = 0; v < watchlist.size(); ++v)
+            report.watchlists += heap_bytes(watchlist[v]);
+
+        report.constraints.reserve(16);
+        for (const auto &c : constraints)
+            report.constraints[typeid(*c)] += c->memory_usage() + heap_bytes(c->scope_vars);
+        for (const auto &[c, instance] : adopted)
+            report.constraints[typeid(*instance)] += instance->memory_usage();
+        report.learnts = heap_bytes(learnts) + heap_bytes(activity) + heap_bytes(learnt_watches);
+#ifdef ARCCONSISTENCY_ENABLE_TRACE
+        report.learnts += heap_bytes(nogood_ids);
+#endif
+        for (const auto &l : learnts)
+            report.learnts += l->memory_usage() + heap_bytes(l->scope_vars);
+
+        report.queue = heap_bytes(to_propagate) + heap_bytes(parked);
+        report.search = heap_bytes(trail) + trail.size() * (sizeof(const utils::enum_val *) + 2 * sizeof(void *)) + heap_bytes(last_removal) + heap_bytes(checkpoints) + heap_bytes(undos) + heap_bytes(undo_marks) + heap_bytes(decisions) + impacts.memory_usage(); // the trail holds the nodes of the removed values
+#ifdef ARCCONSISTENCY_ENABLE_LISTENERS
+        report.listeners = heap_bytes(listening) + heap_bytes(listeners);
+#endif
+
+        report.other = universes.memory_usage() + heap_bytes(universe_of) + heap_bytes(constraints) + heap_bytes(adopted) + heap_bytes(origins) + heap_bytes(*active_constraints) + heap_bytes(folded) + heap_bytes(detached) + heap_bytes(detached_watches);
+        for (const auto &[vals, u] : universe_of)
+            report.other += u->memory_usage();
+        return report;
+    }
+
+    void solver::shrink_to_fit() noexcept
+    {
+        for (utils::var v = 0; v < dom.size(); ++v)
+        {
+            if (!dom.shared(v))
+                dom.mut(v).rehash(0);
+            if (!init_domain.shared(v))
+                init_domain.mut(v).rehash(0);
+            if (!watchlist.shared(v))
+                watchlist.mut(v).rehash(0);
+        }
+        constraints.shrink_to_fit();
+        adopted.rehash(0);
+        origins.rehash(0);
+        if (active_constraints.use_count() == 1)
+            active_constraints->rehash(0);
+        folded.rehash(0);
+        detached.rehash(0);
+        for (auto &[v, ds] : detached_watches)
+            ds.rehash(0);
+        detached_watches.rehash(0);
+        if (q_head == to_propagate.size())
+        {
+            to_propagate.clear();
+            q_head = 0;
+        }
+        to_propagate.shrink_to_fit();
+        parked.shrink_to_fit();
+        if (checkpoints.empty() && n_cleared)
+            compact_trail();
+        trail.shrink_to_fit();
+        checkpoints.shrink_to_fit();
+        undos.shrink_to_fit();
+        undo_marks.shrink_to_fit();
+        decisions.shrink_to_fit();
+        learnts.shrink_to_fit();
+        activity.rehash(0);
+        if (learnts.empty())
+            learnt_watches = {};
+#ifdef ARCCONSISTENCY_ENABLE_LISTENERS
+        listening.rehash(0);
+#endif
+    }
+
 #ifdef ARCCONSISTENCY_ENABLE_LISTENERS
     void solver::add_listener(listener &l) noexcept { listeners.insert(&l); }
     void solver::remove_listener(listener &l) noexcept
@@ -196,7 +1167,7 @@ namespace arc_consistency
         for (std::size_t i = 0; i < s.dom.size(); ++i)
             res += to_string(s, i) + "\n";
         res += "Constraints:\n";
-        for (const auto &c : s.active_constraints)
+        for (const auto &c : *s.active_constraints)
             res += c->to_string() + "\n";
         return res;
     }
@@ -1,16 +1,26 @@
 #include "constraint.hpp"
 #include "arc_consistency.hpp"
+#include <algorithm>
 #include <unordered_set>
+#include <limits>
 #include <cassert>
 
 namespace arc_consistency
 {
-    bool constraint::remove(utils::var v, const utils::enum_val &val) noexcept { return slv.remove(v, val, *this); }
-    std::unordered_set<const utils::enum_val *> &constraint::domain(utils::var v) const noexcept
+    bool constraint::remove(utils::var v, const utils::enum_val &val) noexcept { return slv.remove(v, val, this); }
+    const std::unordered_set<const utils::enum_val *> &constraint::domain(utils::var v) const noexcept
     {
         assert(v < slv.dom.size());
         return slv.dom[v];
     }
+    const domain_universe &constraint::universe(utils::var v) const noexcept { return *slv.universes[v]; }
+    const value_bitset &constraint::bits(utils::var v) const noexcept { return slv.bits_in_step(v); }
+    std::size_t constraint::restorations() const noexcept { return slv.n_restorations; }
+    void constraint::save(std::size_t change) noexcept
+    {
+        if (!slv.checkpoints.empty())
+            slv.undos.emplace_back(this, change);
+    }
 
     assign::assign(solver &slv, utils::var v, const utils::enum_val &val) noexcept : constraint(slv), v{v}, val{val} {}
 
@@ -18,19 +28,22 @@ namespace arc_consistency
 
     bool assign::propagate(utils::var) noexcept
     {
-        auto &var_dom = domain(v);
-        for (auto it = var_dom.begin(); it != var_dom.end();)
+        for (auto it = domain(v).begin(); it != domain(v).end();)
             if (*it != &val)
             {
                 if (!remove(v, **it))
-                    return false;     // Domain wipeout
-                it = var_dom.begin(); // Restart iteration after modification
+                    return false;       // Domain wipeout
+                it = domain(v).begin(); // Restart iteration after modification
             }
             else
                 ++it;
         return true;
     }
 
+    std::unique_ptr<constraint> assign::clone(solver &slv) const noexcept { return std::make_unique<assign>(slv, v, val); }
+
+    std::size_t assign::memory_usage() const noexcept { return sizeof(*this); }
+
     std::string assign::to_string() const noexcept { return "v" + std::to_string(v) + " -> " + val.to_string(); }
 
     forbid::forbid(solver &slv, utils::var v, const utils::enum_val &val) noexcept : constraint(slv), v{v}, val{val} {}
@@ -44,6 +57,10 @@ namespace arc_consistency
         return remove(v, val);
     }
 
+    std::unique_ptr<constraint> forbid::clone(solver &slv) const noexcept { return std::make_unique<forbid>(slv, v, val); }
+
+    std::size_t forbid::memory_usage() const noexcept { return sizeof(*this); }
+
     std::string forbid::to_string() const noexcept { return "v" + std::to_string(v) + " != " + val.to_string(); }
 
     imply::imply(solver &slv, utils::var premise, const utils::enum_val &prem_val, utils::var conclusion, const utils::enum_val &conc_val) noexcept : constraint(slv), premise{premise}, prem_val{prem_val}, conclusion{conclusion}, conc_val{conc_val} {}
@@ -82,6 +99,10 @@ namespace arc_consistency
         return true;
     }
 
+    std::unique_ptr<constraint> imply::clone(solver &slv) const noexcept { return std::make_unique<imply>(slv, premise, prem_val, conclusion, conc_val); }
+
+    std::size_t imply::memory_usage() const noexcept { return sizeof(*this); }
+
     std::string imply::to_string() const noexcept { return "v" + std::to_string(premise) + " = " + prem_val.to_string() + " => v" + std::to_string(conclusion) + " = " + conc_val.to_string(); }
 
     clause::clause(solver &slv, std::vector<utils::lit> &&lits) noexcept : constraint(slv), lits{std::move(lits)} {}
@@ -116,6 +137,10 @@ namespace arc_consistency
         return remove(utils::variable(unassigned_lit), utils::sign(unassigned_lit) ? solver::False : solver::True);
     }
 
+    std::unique_ptr<constraint> clause::clone(solver &slv) const noexcept { return std::make_unique<clause>(slv, std::vector<utils::lit>(lits)); }
+
+    std::size_t clause::memory_usage() const noexcept { return sizeof(*this) + heap_bytes(lits); }
+
     std::string clause::to_string() const noexcept
     {
         std::string result = "(";
@@ -135,16 +160,34 @@ namespace arc_consistency
 
     bool eq::propagate(utils::var v) noexcept
     {
-        auto &var_dom = domain(v);
         auto other_var = (v == var1) ? var2 : var1;
-        auto other_dom = domain(other_var);
-        for (auto &other_val : other_dom)
-            if (var_dom.find(other_val) == var_dom.end() && !remove(other_var, *other_val))
+        if (&universe(v) == &universe(other_var))
+        { // the domains share the same universe, so we compare them word by word..
+            std::vector<std::size_t> unsupported;
+            bits(other_var).for_each_difference(bits(v), [&unsupported](std::size_t i)
+                                                { unsupported.push_back(i); });
+            for (const auto &i : unsupported)
+                if (!remove(other_var, universe(other_var).value(i)))
+                    return false; // Domain wipeout
+            return true;
+        }
+
+        std::vector<const utils::enum_val *> unsupported;
+        const auto &var_dom = domain(v);
+        for (const auto &other_val : domain(other_var))
+            if (var_dom.find(other_val) == var_dom.end())
+                unsupported.push_back(other_val);
+        for (const auto &other_val : unsupported) // the removals might copy the page of the domains, so we do not hold them..
+            if (!remove(other_var, *other_val))
                 return false; // Domain wipeout
 
         return true;
     }
 
+    std::unique_ptr<constraint> eq::clone(solver &slv) const noexcept { return std::make_unique<eq>(slv, var1, var2); }
+
+    std::size_t eq::memory_usage() const noexcept { return sizeof(*this); }
+
     std::string eq::to_string() const noexcept { return "v" + std::to_string(var1) + " = v" + std::to_string(var2); }
 
     neq::neq(solver &slv, utils::var var1, utils::var var2) noexcept : constraint(slv), var1{var1}, var2{var2} {}
@@ -165,5 +208,400 @@ namespace arc_consistency
         return true;
     }
 
+    std::unique_ptr<constraint> neq::clone(solver &slv) const noexcept { return std::make_unique<neq>(slv, var1, var2); }
+
+    std::size_t neq::memory_usage() const noexcept { return sizeof(*this); }
+
     std::string neq::to_string() const noexcept { return "v" + std::to_string(var1) + " ≠ v" + std::to_string(var2); }
+
+    cardinality::cardinality(solver &slv, std::vector<utils::lit> &&lits, std::size_t k, bool exact) noexcept : constraint(slv), lits{std::move(lits)}, k{k}, exact{exact}, vals(this->lits.size(), utils::Undefined), stamp{std::numeric_limits<std::size_t>::max()}
+    {
+        for (std::size_t i = 0; i < this->lits.size(); ++i)
+            occurrences[utils::variable(this->lits[i])].push_back(i);
+    }
+
+    std::vector<utils::var> cardinality::scope() const noexcept
+    {
+        std::vector<utils::var> scope;
+        scope.reserve(occurrences.size());
+        for (const auto &[v, pos] : occurrences)
+            scope.push_back(v);
+        return scope;
+    }
+
+    bool cardinality::propagate(utils::var v) noexcept
+    {
+        if (stamp != restorations())
+        { // some domains have been enlarged by a retraction since the last update, so we count again..
+            n_true = n_false = 0;
+            for (std::size_t i = 0; i < lits.size(); ++i)
+            {
+                vals[i] = slv.sat_val(lits[i]);
+                n_true += vals[i] == utils::True;
+                n_false += vals[i] == utils::False;
+            }
+            stamp = restorations();
+            save(recount); // ..and again once backtracked over this level
+        }
+        else
+            for (const auto &i : occurrences.at(v))
+                update(i);
+
+        if (n_true > k || (exact && lits.size() - n_false < k))
+            return false; // too many true, or too many false, literals
+        if (n_true == k && n_true + n_false < lits.size())
+            return assign_undefined(false);
+        if (exact && lits.size() - n_false == k && n_true < k)
+            return assign_undefined(true);
+        return true;
+    }
+
+    void cardinality::update(std::size_t i) noexcept
+    {
+        const auto val = slv.sat_val(lits[i]);
+        if (val == vals[i])
+            return;
+        assert(vals[i] == utils::Undefined); // domains only shrink between restorations
+        vals[i] = val;
+        if (val == utils::True)
+            ++n_true;
+        else
+            ++n_false;
+        save(i);
+    }
+
+    void cardinality::undo(std::size_t change) noexcept
+    {
+        if (change == recount)
+        {
+            stamp = std::numeric_limits<std::size_t>::max();
+            return;
+        }
+        if (vals[change] == utils::True)
+            --n_true;
+        else
+            --n_false;
+        vals[change] = utils::Undefined;
+    }
+
+    bool cardinality::assign_undefined(bool value) noexcept
+    {
+        for (std::size_t i = 0; i < lits.size(); ++i)
+            if (vals[i] == utils::Undefined)
+            {
+                const auto v = utils::variable(lits[i]);
+                if (slv.sat_val(lits[i]) == utils::Undefined && !remove(v, utils::sign(lits[i]) == value ? solver::False : solver::True))
+                    return false; // Domain wipeout
+                for (const auto &j : occurrences.at(v)) // we are not woken up by our own removals..
+                    update(j);
+            }
+        return n_true <= k && (!exact || lits.size() - n_false >= k);
+    }
+
+    std::unique_ptr<constraint> cardinality::clone(solver &slv) const noexcept { return std::make_unique<cardinality>(slv, std::vector<utils::lit>(lits), k, exact); }
+
+    std::size_t cardinality::memory_usage() const noexcept { return sizeof(*this) + heap_bytes(lits) + heap_bytes(occurrences) + heap_bytes(vals); }
+
+    std::string cardinality::to_string() const noexcept
+    {
+        std::string result = "|{";
+        for (auto it = lits.begin(); it != lits.end(); ++it)
+        {
+            result += utils::to_string(*it);
+            if (it + 1 != lits.end())
+                result += ", ";
+        }
+        result += exact ? "}| = " : "}| ≤ ";
+        result += std::to_string(k);
+        return result;
+    }
+
+    element::element(solver &slv, utils::var y, utils::var x, const std::vector<std::pair<std::reference_wrapper<const utils::enum_val>, std::reference_wrapper<const utils::enum_val>>> &table) noexcept : constraint(slv), y{y}, x{x}, stamp{std::numeric_limits<std::size_t>::max()}
+    {
+        for (const auto &[x_val, y_val] : table)
+            if (this->table.emplace(&x_val.get(), &y_val.get()).second)
+                if (const auto i = universe(x).index_of(x_val); i != domain_universe::npos)
+                    preimage[&y_val.get()].push_back(i);
+    }
+
+    std::vector<utils::var> element::scope() const noexcept { return {y, x}; }
+
+    bool element::propagate(utils::var) noexcept
+    {
+        if (stamp != restorations())
+        { // some domains have been enlarged by a retraction since the last update, so we count again..
+            known_x = value_bitset(universe(x).size());
+            for (auto &[y_val, n_supports] : supports)
+                n_supports = 0;
+            std::vector<const utils::enum_val *> outside;
+            for (const auto &x_val : domain(x))
+                if (const auto it = table.find(x_val); it != table.end())
+                {
+                    known_x.set(universe(x).index_of(*x_val));
+                    ++supports[it->second];
+                }
+                else
+                    outside.push_back(x_val);
+            stamp = restorations();
+            save(recount); // ..and again once backtracked over this level
+            for (const auto &x_val : outside)
+                if (!remove(x, *x_val))
+                    return false; // Domain wipeout
+        }
+
+        // we forget the values removed from the domain of `x` since the last update (the differences are computed word by word, before forgetting)..
+        known_x.for_each_difference(bits(x), [this](std::size_t i)
+                                    { forget(i); });
+
+        // we remove the values of `x` pointing to values no longer in the domain of `y`..
+        for (const auto &[y_val, n_supports] : supports)
+            if (n_supports && !domain(y).count(y_val))
+                for (const auto &i : preimage.at(y_val))
+                    if (known_x.test(i) && !remove_x(i))
+                        return false; // Domain wipeout
+
+        // ..and the values of `y` no longer pointed by any value of `x`
+        std::vector<const utils::enum_val *> unsupported;
+        for (const auto &y_val : domain(y))
+            if (const auto it = supports.find(y_val); it == supports.end() || it->second == 0)
+                unsupported.push_back(y_val);
+        for (const auto &y_val : unsupported)
+            if (!remove(y, *y_val))
+                return false; // Domain wipeout
+        return true;
+    }
+
+    void element::forget(std::size_t i) noexcept
+    {
+        known_x.reset(i);
+        --supports.at(table.at(&universe(x).value(i)));
+        save(i);
+    }
+
+    bool element::remove_x(std::size_t i) noexcept
+    { // we are not woken up by our own removals, so we update the counters right away..
+        forget(i);
+        return remove(x, universe(x).value(i));
+    }
+
+    void element::undo(std::size_t change) noexcept
+    {
+        if (change == recount)
+        {
+            stamp = std::numeric_limits<std::size_t>::max();
+            return;
+        }
+        known_x.set(change);
+        ++supports.at(table.at(&universe(x).value(change)));
+    }
+
+    std::unique_ptr<constraint> element::clone(solver &slv) const noexcept
+    {
+        std::vector<std::pair<std::reference_wrapper<const utils::enum_val>, std::reference_wrapper<const utils::enum_val>>> tbl;
+        tbl.reserve(table.size());
+        for (const auto &[x_val, y_val] : table)
+            tbl.emplace_back(*x_val, *y_val);
+        return std::make_unique<element>(slv, y, x, tbl);
+    }
+
+    std::size_t element::memory_usage() const noexcept { return sizeof(*this) + heap_bytes(table) + heap_bytes(preimage) + known_x.memory_usage() + heap_bytes(supports); }
+
+    std::string element::to_string() const noexcept
+    {
+        std::string result = "v" + std::to_string(y) + " = {";
+        for (auto it = table.begin(); it != table.end(); ++it)
+        {
+            if (it != table.begin())
+                result += ", ";
+            result += it->first->to_string() + " ↦ " + it->second->to_string();
+        }
+        return result + "}[v" + std::to_string(x) + "]";
+    }
+
+    global_cardinality::global_cardinality(solver &slv, std::vector<utils::var> &&vars, const std::vector<std::tuple<std::reference_wrapper<const utils::enum_val>, std::size_t, std::size_t>> &bounds) noexcept : constraint(slv), vars{std::move(vars)}, known(this->vars.size()), n_known(this->vars.size(), 0), stamp{std::numeric_limits<std::size_t>::max()}
+    {
+        for (std::size_t i = 0; i < this->vars.size(); ++i)
+        {
+            occurrences[this->vars[i]].push_back(i);
+            stride = std::max(stride, universe(this->vars[i]).size());
+        }
+        for (const auto &[val, lb, ub] : bounds)
+            counters.emplace(&val.get(), counter{lb, ub, 0, 0});
+    }
+
+    std::vector<utils::var> global_cardinality::scope() const noexcept
+    {
+        std::vector<utils::var> scope;
+        scope.reserve(occurrences.size());
+        for (const auto &[v, pos] : occurrences)
+            scope.push_back(v);
+        return scope;
+    }
+
+    bool global_cardinality::propagate(utils::var v) noexcept
+    {
+        if (stamp != restorations())
+        { // some domains have been enlarged by a retraction since the last update, so we count again..
+            for (auto &[val, cnt] : counters)
+                cnt.n_assigned = cnt.n_possible = 0;
+            for (std::size_t i = 0; i < vars.size(); ++i)
+            {
+                const auto &var_dom = domain(vars[i]);
+                known[i] = bits(vars[i]);
+                n_known[i] = var_dom.size();
+                for (const auto &val : var_dom)
+                    if (const auto it = counters.find(val); it != counters.end())
+                    {
+                        ++it->second.n_possible;
+                        if (var_dom.size() == 1)
+                            ++it->second.n_assigned;
+                    }
+            }
+            stamp = restorations();
+            save(recount); // ..and again once backtracked over this level
+        }
+        else
+            for (const auto &i : occurrences.at(v))
+                update(i);
+
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (const auto &[val, cnt] : counters)
+            {
+                if (cnt.n_assigned > cnt.ub || cnt.n_possible < cnt.lb)
+                    return false; // the value is taken by too many, or can be taken by too few, variables
+                if (cnt.n_assigned == cnt.ub && cnt.n_possible > cnt.n_assigned)
+                { // the value cannot be taken by any other variable..
+                    for (std::size_t i = 0; i < vars.size(); ++i)
+                        if (n_known[i] > 1 && knows(i, *val) && !stale(i, *val))
+                        {
+                            if (!remove(vars[i], *val))
+                                return false; // Domain wipeout
+                            for (const auto &j : occurrences.at(vars[i])) // we are not woken up by our own removals..
+                                update(j);
+                        }
+                    changed = true;
+                }
+                else if (cnt.n_possible == cnt.lb && cnt.n_assigned < cnt.lb)
+                { // the value must be taken by all the variables that can take it..
+                    for (std::size_t i = 0; i < vars.size(); ++i)
+                        if (n_known[i] > 1 && knows(i, *val) && !stale(i, *val))
+                        {
+                            std::vector<const utils::enum_val *> others;
+                            for (const auto &other : domain(vars[i]))
+                                if (other != val)
+                                    others.push_back(other);
+                            for (const auto &other : others)
+                                if (!remove(vars[i], *other))
+                                    return false; // Domain wipeout
+                            for (const auto &j : occurrences.at(vars[i]))
+                                update(j);
+                        }
+                    changed = true;
+                }
+                if (changed)
+                    break; // the counters have changed, so we check them again
+            }
+        }
+        return true;
+    }
+
+    void global_cardinality::update(std::size_t i) noexcept
+    {
+        const auto &u = universe(vars[i]);
+        const bool was_assigned = n_known[i] == 1;
+        known[i].for_each_difference(bits(vars[i]), [this, i, &u, was_assigned](std::size_t idx)
+                                     { // the value has been removed since the last update (the differences are computed word by word, before forgetting)..
+                                         known[i].reset(idx);
+                                         --n_known[i];
+                                         if (const auto it = counters.find(&u.value(idx)); it != counters.end())
+                                         {
+                                             --it->second.n_possible;
+                                             if (was_assigned)
+                                                 --it->second.n_assigned;
+                                         }
+                                         save(2 * (i * stride + idx));
+                                     });
+        if (!was_assigned && n_known[i] == 1)
+        { // ..and the variable has become assigned
+            const auto &val = **domain(vars[i]).begin();
+            if (const auto it = counters.find(&val); it != counters.end())
+                ++it->second.n_assigned;
+            save(2 * (i * stride + u.index_of(val)) + 1);
+        }
+    }
+
+    bool global_cardinality::knows(std::size_t i, const utils::enum_val &val) const noexcept
+    {
+        const auto idx = universe(vars[i]).index_of(val);
+        return idx != domain_universe::npos && known[i].test(idx);
+    }
+
+    bool global_cardinality::stale(std::size_t i, const utils::enum_val &val) noexcept
+    {
+        for (const auto &j : occurrences.at(vars[i]))
+            update(j);
+        return n_known[i] == 1 || !knows(i, val);
+    }
+
+    void global_cardinality::undo(std::size_t change) noexcept
+    {
+        if (change == recount)
+        {
+            stamp = std::numeric_limits<std::size_t>::max();
+            return;
+        }
+        const auto i = change / 2 / stride, idx = change / 2 % stride;
+        const auto it = counters.find(&universe(vars[i]).value(idx));
+        if (change % 2)
+        { // the variable is no longer assigned..
+            if (it != counters.end())
+                --it->second.n_assigned;
+            return;
+        }
+        // ..or the value is back in its domain
+        known[i].set(idx);
+        if (it != counters.end())
+        {
+            ++it->second.n_possible;
+            if (++n_known[i] == 1)
+                ++it->second.n_assigned; // the variable was assigned to the value before its removal
+        }
+        else
+            ++n_known[i];
+    }
+
+    std::unique_ptr<constraint> global_cardinality::clone(solver &slv) const noexcept
+    {
+        std::vector<std::tuple<std::reference_wrapper<const utils::enum_val>, std::size_t, std::size_t>> bounds;
+        bounds.reserve(counters.size());
+        for (const auto &[val, cnt] : counters)
+            bounds.emplace_back(*val, cnt.lb, cnt.ub);
+        return std::make_unique<global_cardinality>(slv, std::vector<utils::var>(vars), bounds);
+    }
+
+    std::size_t global_cardinality::memory_usage() const noexcept
+    {
+        std::size_t bytes = sizeof(*this) + heap_bytes(vars) + heap_bytes(occurrences) + heap_bytes(counters) + heap_bytes(known) + heap_bytes(n_known);
+        for (const auto &k : known)
+            bytes += k.memory_usage();
+        return bytes;
+    }
+
+    std::string global_cardinality::to_string() const noexcept
+    {
+        std::string result = "gcc({";
+        for (auto it = vars.begin(); it != vars.end(); ++it)
+        {
+            if (it != vars.begin())
+                result += ", ";
+            result += "v" + std::to_string(*it);
+        }
+        result += "}";
+        for (const auto &[val, cnt] : counters)
+            result += ", " + val->to_string() + " ∈ [" + std::to_string(cnt.lb) + ", " + std::to_string(cnt.ub) + "]";
+        return result + ")";
+    }
 } // namespace arc_consistency
@@ -0,0 +1,40 @@
+#include "domain_universe.hpp"
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace arc_consistency
+{
+    domain_universe::domain_universe(const std::vector<std::reference_wrapper<const utils::enum_val>> &vals) noexcept
+    {
+        this->vals.reserve(vals.size());
+        for (const auto &val : vals)
+            if (indices.emplace(&val.get(), this->vals.size()).second)
+                this->vals.push_back(&val.get());
+    }
+
+    value_bitset::value_bitset(std::size_t n, bool full) noexcept : words((n + 63) / 64, full ? ~std::uint64_t(0) : 0)
+    {
+        if (full && n % 64)
+            words.back() = (std::uint64_t(1) << (n % 64)) - 1; // we clear the bits beyond the size
+    }
+
+    bool value_bitset::intersects(const value_bitset &other) const noexcept
+    {
+        assert(words.size() == other.words.size());
+        std::size_t w = 0;
+#ifdef __AVX2__
+        for (; w + 4 <= words.size(); w += 4)
+        {
+            const auto lhs = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(words.data() + w));
+            const auto rhs = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(other.words.data() + w));
+            if (!_mm256_testz_si256(lhs, rhs))
+                return true;
+        }
+#endif
+        for (; w < words.size(); ++w)
+            if (words[w] & other.words[w])
+                return true;
+        return false;
+    }
+} // namespace arc_consistency
@@ -0,0 +1,125 @@
+#include "portfolio.hpp"
+#include "logging.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace arc_consistency
+{
+    portfolio::portfolio(const solver &base, std::vector<search_options> &&configs) noexcept : configs(std::move(configs)), rings(this->configs.size()), cursors(this->configs.size(), std::vector<std::size_t>(this->configs.size(), 0))
+    {
+        for (std::size_t i = 0; i < this->configs.size(); ++i)
+        {
+            workers.push_back(base.fork());
+            auto &w = *workers.back();
+            w.stop = &stop;
+            w.on_learnt = [this, i](const clause &c)
+            { share(i, c); };
+            w.on_restart = [this, i]
+            { import(i); };
+        }
+    }
+
+    static std::vector<search_options> diversify(std::size_t n_workers) noexcept
+    {
+        constexpr var_heuristic heuristics[] = {var_heuristic::dom_wdeg, var_heuristic::dom, var_heuristic::impact};
+        std::vector<search_options> configs(n_workers);
+        for (std::size_t i = 0; i < n_workers; ++i)
+        {
+            configs[i].heuristic = heuristics[i % 3];
+            configs[i].learning = true;
+            configs[i].restart_base = 50 + 25 * (i % 4);
+            configs[i].seed = static_cast<unsigned>(i); // the first worker keeps the deterministic value ordering
+        }
+        return configs;
+    }
+
+    portfolio::portfolio(const solver &base, std::size_t n_workers) noexcept : portfolio(base, diversify(n_workers)) {}
+
+    bool portfolio::solve() noexcept
+    {
+        assert(!workers.empty());
+        stop = false;
+        for (auto &r : rings)
+            r.published = 0;
+        for (auto &c : cursors)
+            std::fill(c.begin(), c.end(), 0);
+        n_missed = 0;
+
+        bool result = false;
+        std::vector<std::thread> threads;
+        threads.reserve(workers.size());
+        for (std::size_t i = 0; i < workers.size(); ++i)
+            threads.emplace_back([this, i, &result]
+                                 {
+                                     const bool res = workers[i]->solve(configs[i]);
+                                     if (!stop.exchange(true))
+                                     { // this worker is the first to complete its search..
+                                         LOG_DEBUG("Worker " + std::to_string(i) + " completed the search");
+                                         winner_idx = i;
+                                         result = res;
+                                     } });
+        for (auto &t : threads)
+            t.join();
+        if (n_missed)
+        { // some workers restart too seldom to keep up with the others..
+            LOG_DEBUG("The workers skipped " + std::to_string(n_missed.load()) + " overwritten nogoods");
+        }
+        return result;
+    }
+
+    void portfolio::share(std::size_t source, const clause &c) noexcept
+    {
+        const auto &lits = c.get_lits();
+        if (lits.size() > max_shared_size)
+            return;
+        auto &ring = rings[source];
+        const auto pos = ring.published.load(std::memory_order_relaxed); // only this worker writes its ring
+        auto &sn = ring.slots[pos % ring_capacity];
+        sn.seq.store(writing, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        sn.size.store(lits.size(), std::memory_order_relaxed);
+        for (std::size_t i = 0; i < lits.size(); ++i)
+            sn.lits[i].store(2 * utils::variable(lits[i]) + utils::sign(lits[i]), std::memory_order_relaxed);
+        sn.seq.store(pos + 1, std::memory_order_release);
+        ring.published.store(pos + 1, std::memory_order_release);
+    }
+
+    void portfolio::import(std::size_t worker) noexcept
+    {
+        for (std::size_t source = 0; source < rings.size(); ++source)
+        {
+            if (source == worker)
+                continue;
+            auto &ring = rings[source];
+            auto &cursor = cursors[worker][source];
+            const auto end = ring.published.load(std::memory_order_acquire);
+            if (end - cursor > ring_capacity)
+            { // the oldest nogoods we have not read are gone..
+                n_missed.fetch_add(end - ring_capacity - cursor, std::memory_order_relaxed);
+                cursor = end - ring_capacity;
+            }
+            for (; cursor < end; ++cursor)
+            {
+                const auto &sn = ring.slots[cursor % ring_capacity];
+                const auto seq = sn.seq.load(std::memory_order_acquire);
+                std::vector<utils::lit> lits;
+                if (seq == cursor + 1)
+                {
+                    const auto size = std::min(sn.size.load(std::memory_order_relaxed), max_shared_size);
+                    for (std::size_t i = 0; i < size; ++i)
+                    {
+                        const auto code = sn.lits[i].load(std::memory_order_relaxed);
+                        lits.emplace_back(code / 2, code % 2);
+                    }
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                }
+                if (seq != cursor + 1 || sn.seq.load(std::memory_order_relaxed) != seq)
+                { // the nogood has been overwritten while we were getting to it, or reading it..
+                    n_missed.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                workers[worker]->import_nogood(std::move(lits));
+            }
+        }
+    }
+} // namespace arc_consistency
@@ -0,0 +1,376 @@
+#include "sat_solver.hpp"
+#include "logging.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace arc_consistency
+{
+    /**
+     * @brief Returns the literal stating that the boolean variable `x` takes the value `val`.
+     */
+    static utils::lit is(utils::var x, const utils::enum_val &val) noexcept
+    {
+        assert(&val == &solver::True || &val == &solver::False);
+        return utils::lit(x, &val == &solver::True);
+    }
+
+    std::string sat_constraint::to_string() const noexcept
+    {
+        std::string result;
+        for (auto c_it = clauses.begin(); c_it != clauses.end(); ++c_it)
+        {
+            if (c_it != clauses.begin())
+                result += " ∧ ";
+            result += "(";
+            for (auto it = c_it->begin(); it != c_it->end(); ++it)
+            {
+                result += utils::to_string(*it);
+                if (it + 1 != c_it->end())
+                    result += " ∨ ";
+            }
+            result += ")";
+        }
+        return result;
+    }
+
+    sat_solver::sat_solver() noexcept
+    {
+        utils::var c_false = new_sat();
+        assert(c_false == utils::FALSE_var);
+        assign(utils::lit(c_false, false));
+    }
+
+    utils::var sat_solver::new_sat() noexcept
+    {
+        const auto x = n_vars++;
+        vals.resize((n_vars + 31) / 32, 0);
+        watches.resize(n_vars * 2);
+        return x;
+    }
+
+    utils::lbool sat_solver::sat_val(const utils::var &x) const noexcept
+    {
+        assert(x < n_vars);
+        const auto b = bits(x);
+        if (!(b & 2))
+            return utils::Undefined; // variable is unassigned
+        return (b & 1) ? utils::True : utils::False;
+    }
+
+    utils::lbool sat_solver::sat_val(const utils::lit &l) const noexcept
+    {
+        switch (sat_val(utils::variable(l)))
+        {
+        case utils::True:
+            return utils::sign(l) ? utils::True : utils::False;
+        case utils::False:
+            return utils::sign(l) ? utils::False : utils::True;
+        default:
+            return utils::Undefined;
+        }
+    }
+
+    sat_constraint &sat_solver::new_clause(std::vector<utils::lit> &&lits) noexcept
+    {
+        constraints.emplace_back(std::make_unique<sat_constraint>(std::vector<std::vector<utils::lit>>{std::move(lits)}));
+        return *constraints.back();
+    }
+    sat_constraint &sat_solver::new_equal(utils::var x, utils::var y) noexcept
+    {
+        constraints.emplace_back(std::make_unique<sat_constraint>(std::vector<std::vector<utils::lit>>{{utils::lit(x, false), utils::lit(y)}, {utils::lit(x), utils::lit(y, false)}}));
+        return *constraints.back();
+    }
+    sat_constraint &sat_solver::new_distinct(utils::var x, utils::var y) noexcept
+    {
+        constraints.emplace_back(std::make_unique<sat_constraint>(std::vector<std::vector<utils::lit>>{{utils::lit(x), utils::lit(y)}, {utils::lit(x, false), utils::lit(y, false)}}));
+        return *constraints.back();
+    }
+    sat_constraint &sat_solver::new_imply(utils::var premise, const utils::enum_val &prem_val, utils::var conclusion, const utils::enum_val &conc_val) noexcept
+    {
+        constraints.emplace_back(std::make_unique<sat_constraint>(std::vector<std::vector<utils::lit>>{{!is(premise, prem_val), is(conclusion, conc_val)}}));
+        return *constraints.back();
+    }
+    sat_constraint &sat_solver::new_assign(utils::var x, const utils::enum_val &val) noexcept
+    {
+        constraints.emplace_back(std::make_unique<sat_constraint>(std::vector<std::vector<utils::lit>>{{is(x, val)}}));
+        return *constraints.back();
+    }
+    sat_constraint &sat_solver::new_forbid(utils::var x, const utils::enum_val &val) noexcept
+    {
+        constraints.emplace_back(std::make_unique<sat_constraint>(std::vector<std::vector<utils::lit>>{{!is(x, val)}}));
+        return *constraints.back();
+    }
+
+    sat_constraint &sat_solver::new_at_most(std::vector<utils::lit> &&lits, std::size_t k) noexcept
+    {
+        std::vector<std::vector<utils::lit>> cls;
+        at_most(lits, k, cls);
+        constraints.emplace_back(std::make_unique<sat_constraint>(std::move(cls)));
+        return *constraints.back();
+    }
+    sat_constraint &sat_solver::new_exactly(std::vector<utils::lit> &&lits, std::size_t k) noexcept
+    {
+        std::vector<std::vector<utils::lit>> cls;
+        at_most(lits, k, cls);
+        if (k > lits.size())
+            cls.emplace_back(); // not enough literals, so the empty clause..
+        else
+        { // ..or at most `n - k` false literals
+            std::vector<utils::lit> neg_lits;
+            neg_lits.reserve(lits.size());
+            for (const auto &l : lits)
+                neg_lits.push_back(!l);
+            at_most(neg_lits, lits.size() - k, cls);
+        }
+        constraints.emplace_back(std::make_unique<sat_constraint>(std::move(cls)));
+        return *constraints.back();
+    }
+
+    void sat_solver::at_most(const std::vector<utils::lit> &lits, std::size_t k, std::vector<std::vector<utils::lit>> &cls) noexcept
+    {
+        if (k >= lits.size())
+            return; // the constraint is trivially satisfied
+        if (k == 0)
+        {
+            for (const auto &l : lits)
+                cls.push_back({!l});
+            return;
+        }
+        // the j-th counter variable after the i-th literal is true if at least `j + 1` of the first `i + 1` literals are true..
+        std::vector<utils::var> prev(k), curr(k);
+        for (auto &x : prev)
+            x = new_sat();
+        cls.push_back({!lits[0], utils::lit(prev[0])});
+        for (std::size_t j = 1; j < k; ++j)
+            cls.push_back({utils::lit(prev[j], false)});
+        for (std::size_t i = 1; i + 1 < lits.size(); ++i)
+        {
+            for (auto &x : curr)
+                x = new_sat();
+            cls.push_back({!lits[i], utils::lit(curr[0])});
+            cls.push_back({utils::lit(prev[0], false), utils::lit(curr[0])});
+            for (std::size_t j = 1; j < k; ++j)
+            {
+                cls.push_back({!lits[i], utils::lit(prev[j - 1], false), utils::lit(curr[j])});
+                cls.push_back({utils::lit(prev[j], false), utils::lit(curr[j])});
+            }
+            cls.push_back({!lits[i], utils::lit(prev[k - 1], false)}); // ..and no literal can be true once `k` are
+            std::swap(prev, curr);
+        }
+        cls.push_back({!lits.back(), utils::lit(prev[k - 1], false)});
+    }
+
+    void sat_solver::add_constraint(sat_constraint &c) noexcept
+    {
+        LOG_TRACE("Adding " + c.to_string());
+        assert(c.ids.empty());
+        backtrack_to_root();
+        for (const auto &lits : c.clauses)
+        {
+            c.ids.push_back(clauses.size());
+            clauses.push_back({lits, true});
+            watch(c.ids.back());
+        }
+    }
+
+    void sat_solver::retract(sat_constraint &c) noexcept
+    {
+        LOG_TRACE("Retracting " + c.to_string());
+        backtrack_to_root();
+        for (const auto &id : c.ids)
+            clauses[id].active = false;
+        n_inactive += c.ids.size();
+        c.ids.clear();
+
+        // we start again from an empty assignment..
+        undo(0);
+        inconsistent = false;
+        for (auto &ws : watches)
+            ws.clear();
+        if (n_inactive > clauses.size() / 2)
+        { // ..dropping the clauses of the retracted constraints
+            std::vector<std::size_t> new_ids(clauses.size());
+            std::size_t n_active = 0;
+            for (std::size_t id = 0; id < clauses.size(); ++id)
+                if (clauses[id].active)
+                {
+                    new_ids[id] = n_active;
+                    if (n_active != id) // moving a clause onto itself would empty it
+                        clauses[n_active] = std::move(clauses[id]);
+                    ++n_active;
+                }
+            clauses.resize(n_active);
+            for (const auto &cc : constraints)
+                for (auto &id : cc->ids)
+                    id = new_ids[id];
+            n_inactive = 0;
+        }
+        assign(utils::lit(utils::FALSE_var, false));
+        for (std::size_t id = 0; id < clauses.size(); ++id)
+            if (clauses[id].active)
+                watch(id);
+    }
+
+    bool sat_solver::propagate() noexcept
+    {
+        if (inconsistent)
+            return false;
+        while (q_head < trail.size())
+        {
+            const auto false_lit = !trail[q_head++];
+            auto &ws = watches[index(false_lit)];
+            std::size_t j = 0;
+            for (std::size_t i = 0; i < ws.size(); ++i)
+            {
+                const auto id = ws[i];
+                auto &c = clauses[id];
+                if (!c.active)
+                    continue; // the clause has been retracted, so we stop watching it
+                auto &lits = c.lits;
+                if (lits[0] == false_lit)
+                    std::swap(lits[0], lits[1]);
+                if (sat_val(lits[0]) == utils::True)
+                { // the clause is satisfied by the other watched literal..
+                    ws[j++] = id;
+                    continue;
+                }
+                bool moved = false;
+                for (std::size_t k = 2; k < lits.size(); ++k)
+                    if (sat_val(lits[k]) != utils::False)
+                    { // ..or it can watch another literal..
+                        std::swap(lits[1], lits[k]);
+                        watches[index(lits[1])].push_back(id);
+                        moved = true;
+                        break;
+                    }
+                if (moved)
+                    continue;
+                ws[j++] = id;
+                if (sat_val(lits[0]) == utils::False)
+                { // ..or it is falsified..
+                    while (++i < ws.size())
+                        ws[j++] = ws[i];
+                    ws.resize(j);
+                    q_head = trail.size();
+                    if (decisions.empty())
+                        inconsistent = true;
+                    return false;
+                }
+                assign(lits[0]); // ..or it is unit
+            }
+            ws.resize(j);
+        }
+        return true;
+    }
+
+    bool sat_solver::solve() noexcept
+    {
+        LOG_TRACE("Solving");
+        backtrack_to_root();
+        if (!propagate())
+            return false;
+        utils::var next = 0; // the variables before `next` are all assigned
+        while (true)
+        {
+            while (next < n_vars && (bits(next) & 2))
+                ++next;
+            if (next == n_vars)
+                return true; // all the variables are assigned
+            decisions.push_back({trail.size(), utils::lit(next, false), false});
+            assign(decisions.back().lit);
+            while (!propagate())
+            { // we undo the refuted decisions, and refute the last one which is not..
+                while (!decisions.empty() && decisions.back().refuted)
+                {
+                    undo(decisions.back().size);
+                    decisions.pop_back();
+                }
+                if (decisions.empty())
+                    return false; // the search space is exhausted
+                auto &d = decisions.back();
+                undo(d.size);
+                d.refuted = true;
+                next = utils::variable(d.lit);
+                assign(!d.lit);
+            }
+        }
+    }
+
+    void sat_solver::assign(const utils::lit &l) noexcept
+    {
+        const auto v = utils::variable(l);
+        assert(!(bits(v) & 2));
+        vals[v / 32] |= (std::uint64_t(2) | utils::sign(l)) << (2 * (v % 32));
+        trail.push_back(l);
+    }
+
+    void sat_solver::watch(std::size_t id) noexcept
+    {
+        auto &lits = clauses[id].lits;
+        const auto rank = [this](const utils::lit &l)
+        {
+            switch (sat_val(l))
+            {
+            case utils::True:
+                return 0;
+            case utils::Undefined:
+                return 1;
+            default:
+                return 2;
+            }
+        };
+        // the true literals come first, then the unassigned ones, then the false ones..
+        std::stable_sort(lits.begin(), lits.end(), [&rank](const auto &l0, const auto &l1)
+                         { return rank(l0) < rank(l1); });
+        if (lits.empty() || sat_val(lits[0]) == utils::False)
+            inconsistent = true; // the clause is falsified
+        else if ((lits.size() == 1 || sat_val(lits[1]) == utils::False) && sat_val(lits[0]) == utils::Undefined)
+            assign(lits[0]); // the clause is unit
+        if (lits.size() >= 2)
+        {
+            watches[index(lits[0])].push_back(id);
+            watches[index(lits[1])].push_back(id);
+        }
+    }
+
+    void sat_solver::undo(std::size_t size) noexcept
+    {
+        while (trail.size() > size)
+        {
+            const auto v = utils::variable(trail.back());
+            vals[v / 32] &= ~(std::uint64_t(3) << (2 * (v % 32)));
+            trail.pop_back();
+        }
+        q_head = std::min(q_head, size);
+    }
+
+    void sat_solver::backtrack_to_root() noexcept
+    {
+        if (!decisions.empty())
+            undo(decisions.front().size);
+        decisions.clear();
+    }
+
+    std::string to_string(const sat_solver &s) noexcept
+    {
+        std::string res = "Solver State:\n";
+        for (utils::var v = 0; v < s.n_vars; ++v)
+            switch (s.sat_val(v))
+            {
+            case utils::True:
+                res += "b" + std::to_string(v) + " = " + solver::True.to_string() + "\n";
+                break;
+            case utils::False:
+                res += "b" + std::to_string(v) + " = " + solver::False.to_string() + "\n";
+                break;
+            default:
+                res += "b" + std::to_string(v) + " ∈ {" + solver::True.to_string() + ", " + solver::False.to_string() + "}\n";
+                break;
+            }
+        res += "Constraints:\n";
+        for (const auto &c : s.constraints)
+            if (c->is_active())
+                res += c->to_string() + "\n";
+        return res;
+    }
+} // namespace arc_consistency
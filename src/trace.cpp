@@ -0,0 +1,42 @@
+#include "trace.hpp"
+#include "constraint.hpp"
+
+namespace arc_consistency
+{
+    static std::size_t next_power_of_two(std::size_t n) noexcept
+    {
+        std::size_t p = 1;
+        while (p < n)
+            p <<= 1;
+        return p;
+    }
+
+    trace_buffer::trace_buffer(std::size_t capacity) noexcept : events(next_power_of_two(capacity)), mask(events.size() - 1) {}
+
+    static std::string describe(const trace_event &e) noexcept { return e.c ? e.c->to_string() : "nogood #" + std::to_string(e.nogood); }
+
+    std::string to_string(const trace_event &e) noexcept
+    {
+        switch (e.kind)
+        {
+        case trace_kind::propagate:
+            return "Propagating " + describe(e) + " on v" + std::to_string(e.var);
+        case trace_kind::remove:
+            return "Removing " + e.val->to_string() + " from v" + std::to_string(e.var) + (e.c || e.nogood ? " by " + describe(e) : "");
+        case trace_kind::conflict:
+            return "Conflict on " + describe(e);
+        case trace_kind::retract:
+            return "Retracting " + describe(e);
+        case trace_kind::refute:
+            return "Refuting v" + std::to_string(e.var) + " = " + e.val->to_string();
+        case trace_kind::restart:
+            return "Restarting after " + std::to_string(e.var) + " conflicts";
+        case trace_kind::learn:
+            return "Learned " + describe(e);
+        case trace_kind::import:
+            return "Imported " + describe(e);
+        default:
+            return "Pruning v" + std::to_string(e.var) + " = " + e.val->to_string();
+        }
+    }
+} // namespace arc_consistency
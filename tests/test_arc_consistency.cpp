@@ -1,6 +1,11 @@
 #include "arc_consistency.hpp"
+#include "portfolio.hpp"
+#include "sat_solver.hpp"
 #include "logging.hpp"
+#include <algorithm>
 #include <cassert>
+#include <random>
+#include <thread>
 
 class test_enum_val : public utils::enum_val
 {
@@ -190,6 +195,1095 @@ void test6()
     assert(s.domain(premise).size() == 1 && *s.domain(premise).begin() == &arc_consistency::solver::False);
 }
 
+void test7()
+{
+    test_enum_val a("A");
+    test_enum_val b("B");
+    test_enum_val c("C");
+
+    arc_consistency::solver s;
+    std::vector<utils::var> vars;
+    for (std::size_t i = 0; i < 10; ++i)
+        vars.push_back(s.new_var({a, b, c}));
+    for (std::size_t i = 1; i < vars.size(); ++i)
+        s.add_constraint(s.new_equal(vars[i - 1], vars[i]));
+    s.add_constraint(s.new_assign(vars[0], b));
+    std::size_t suspensions = 0;
+    arc_consistency::propagation_status status;
+    while ((status = s.propagate(1)) == arc_consistency::propagation_status::suspended)
+        ++suspensions;
+    assert(status == arc_consistency::propagation_status::fixpoint);
+    assert(suspensions > 0);
+    LOG_DEBUG(arc_consistency::to_string(s));
+    for (const auto &v : vars)
+        assert(s.domain(v).size() == 1 && *s.domain(v).begin() == &b);
+}
+
+void test8()
+{
+    test_enum_val a("A");
+    test_enum_val b("B");
+    test_enum_val c("C");
+
+    arc_consistency::solver s;
+    const auto v0 = s.new_var({a, b});
+    const auto v1 = s.new_var({a, b});
+    const auto v2 = s.new_var({a, b, c});
+    s.add_constraint(s.new_distinct(v0, v1));
+    s.add_constraint(s.new_distinct(v0, v2));
+    s.add_constraint(s.new_distinct(v1, v2));
+    auto prop = s.propagate();
+    assert(prop);
+    assert(s.domain(v2).size() == 3);
+    prop = s.singleton_propagate();
+    assert(prop);
+    LOG_DEBUG(arc_consistency::to_string(s));
+    assert(s.domain(v0).size() == 2);
+    assert(s.domain(v1).size() == 2);
+    assert(s.domain(v2).size() == 1 && *s.domain(v2).begin() == &c);
+    s.add_constraint(s.new_forbid(v2, c));
+    prop = s.singleton_propagate();
+    assert(!prop);
+
+    // the probes can be shared among threads, reaching the same domains..
+    arc_consistency::solver ps;
+    std::vector<utils::var> xs;
+    for (std::size_t i = 0; i < 6; ++i)
+        xs.push_back(ps.new_var({a, b, c}));
+    for (std::size_t i = 0; i < 3; ++i)
+        for (std::size_t j = i + 1; j < 3; ++j)
+            ps.add_constraint(ps.new_distinct(xs[i], xs[j]));
+    ps.add_constraint(ps.new_forbid(xs[0], c));
+    ps.add_constraint(ps.new_forbid(xs[1], c));
+    ps.add_constraint(ps.new_equal(xs[3], xs[4]));
+    ps.add_constraint(ps.new_distinct(xs[2], xs[4]));
+    ps.add_constraint(ps.new_distinct(xs[4], xs[5]));
+    auto seq = ps.fork();
+    prop = seq->singleton_propagate();
+    assert(prop);
+    prop = ps.singleton_propagate(4);
+    assert(prop);
+    for (const auto &x : xs)
+        assert(ps.domain(x) == seq->domain(x));
+    assert(ps.domain(xs[2]).size() == 1 && *ps.domain(xs[2]).begin() == &c);
+    assert(ps.domain(xs[4]).size() == 2 && ps.domain(xs[5]).size() == 3);
+    // ..and the conflicts
+    ps.add_constraint(ps.new_forbid(xs[2], c));
+    prop = ps.singleton_propagate(4);
+    assert(!prop);
+}
+
+void test9()
+{
+    test_enum_val r("R");
+    test_enum_val g("G");
+    test_enum_val b("B");
+
+    for (const auto h : {arc_consistency::var_heuristic::dom, arc_consistency::var_heuristic::dom_wdeg, arc_consistency::var_heuristic::impact})
+    {
+        arc_consistency::solver s;
+        std::vector<utils::var> vars;
+        for (std::size_t i = 0; i < 6; ++i)
+            vars.push_back(s.new_var({r, g, b}));
+        for (std::size_t i = 0; i < vars.size(); ++i) // a wheel..
+            s.add_constraint(s.new_distinct(vars[i], vars[(i + 1) % vars.size()]));
+        auto &c = s.new_equal(vars[0], vars[3]);
+        s.add_constraint(c);
+        auto sol = s.solve({h, true, 2});
+        assert(sol);
+        LOG_DEBUG(arc_consistency::to_string(s));
+        for (std::size_t i = 0; i < vars.size(); ++i)
+        {
+            assert(s.domain(vars[i]).size() == 1);
+            assert(*s.domain(vars[i]).begin() != *s.domain(vars[(i + 1) % vars.size()]).begin());
+        }
+        assert(*s.domain(vars[0]).begin() == *s.domain(vars[3]).begin());
+
+        // with four mutually distinct variables and three colors, there is no solution..
+        s.add_constraint(s.new_distinct(vars[0], vars[2]));
+        s.add_constraint(s.new_distinct(vars[1], vars[3]));
+        s.add_constraint(s.new_distinct(vars[0], vars[3]));
+        s.retract(c);
+        auto prop = s.propagate();
+        assert(prop);
+        sol = s.solve({h, true, 2});
+        assert(!sol);
+        // ..and the solver stays inconsistent until a retraction
+        sol = s.solve({h, true, 2});
+        assert(!sol);
+        prop = s.propagate();
+        assert(!prop);
+    }
+
+    // three mutually distinct booleans are refuted at the root level, along with an unconstrained one decided before them..
+    arc_consistency::solver s;
+    const auto u = s.new_sat();
+    const auto x = s.new_sat();
+    const auto y = s.new_sat();
+    const auto z = s.new_sat();
+    s.add_constraint(s.new_distinct(x, y));
+    s.add_constraint(s.new_distinct(y, z));
+    auto &c = s.new_distinct(x, z);
+    s.add_constraint(c);
+    for (const bool learning : {false, true})
+    {
+        arc_consistency::search_options opts;
+        opts.heuristic = arc_consistency::var_heuristic::dom;
+        opts.learning = learning;
+        auto sol = s.solve(opts);
+        assert(!sol);
+        sol = s.solve(opts);
+        assert(!sol);
+        const auto prop = s.propagate();
+        assert(!prop);
+    }
+    // ..retracting an unrelated constraint does not make them consistent..
+    const auto w = s.new_sat();
+    auto &cw = s.new_assign(w, arc_consistency::solver::True);
+    s.add_constraint(cw);
+    s.retract(cw);
+    auto sol = s.solve();
+    assert(!sol);
+    // ..while retracting one of their constraints does
+    s.retract(c);
+    assert(s.domain(u).size() == 2);
+    sol = s.solve();
+    assert(sol);
+    assert(s.sat_val(x) != s.sat_val(y) && s.sat_val(y) != s.sat_val(z));
+
+    // a conflict of the propagation alone survives the retraction of an unrelated constraint..
+    auto &cw1 = s.new_forbid(w, arc_consistency::solver::False);
+    s.add_constraint(cw1);
+    auto &cx = s.new_forbid(x, arc_consistency::solver::False);
+    s.add_constraint(cx);
+    auto &cy = s.new_forbid(y, arc_consistency::solver::False);
+    s.add_constraint(cy);
+    auto prop = s.propagate();
+    assert(!prop);
+    s.retract(cw1);
+    prop = s.propagate();
+    assert(!prop);
+    assert(s.domain(w).size() == 2);
+    // ..and not that of one of the conflicting constraints
+    s.retract(cy);
+    prop = s.propagate();
+    assert(prop);
+    assert(s.sat_val(x) == utils::True && s.sat_val(y) == utils::False);
+}
+
+void test10()
+{
+    arc_consistency::solver s;
+    const auto x = s.new_sat();
+    const auto y = s.new_sat();
+    const auto z = s.new_sat();
+    const auto w = s.new_sat();
+    auto &c0 = s.new_clause({{x, false}, {y, false}});
+    auto &c1 = s.new_assign(x, arc_consistency::solver::True);
+    auto &c2 = s.new_assign(y, arc_consistency::solver::True);
+    auto &c3 = s.new_equal(z, w);
+    s.add_constraint(c0);
+    s.add_constraint(c3);
+    s.add_constraint(c1);
+    auto prop = s.propagate();
+    assert(prop);
+    s.add_constraint(c2);
+    prop = s.propagate();
+    assert(!prop);
+    const auto expl = s.explain_conflict();
+    assert(expl.assumptions.empty());
+    assert(expl.constraints.size() == 3);
+    assert(std::find(expl.constraints.begin(), expl.constraints.end(), &c3) == expl.constraints.end());
+
+    // the pigeonhole problem, with five pigeons and four holes, is unsatisfiable..
+    const std::size_t n_holes = 4;
+    arc_consistency::solver php;
+    std::vector<std::vector<utils::var>> p(n_holes + 1);
+    for (auto &pigeon : p)
+    {
+        std::vector<utils::lit> in_some_hole;
+        for (std::size_t h = 0; h < n_holes; ++h)
+        {
+            pigeon.push_back(php.new_sat());
+            in_some_hole.emplace_back(pigeon.back(), true);
+        }
+        php.add_constraint(php.new_clause(std::move(in_some_hole)));
+    }
+    for (std::size_t h = 0; h < n_holes; ++h)
+        for (std::size_t i = 0; i < p.size(); ++i)
+            for (std::size_t j = i + 1; j < p.size(); ++j)
+                php.add_constraint(php.new_clause({{p[i][h], false}, {p[j][h], false}}));
+    arc_consistency::search_options opts;
+    opts.learning = true;
+    opts.max_learnts = 8;
+    auto sol = php.solve(opts);
+    assert(!sol);
+
+    // without the last pigeon, the problem becomes satisfiable..
+    arc_consistency::solver php_sat;
+    std::vector<std::vector<utils::var>> q(n_holes);
+    for (auto &pigeon : q)
+    {
+        std::vector<utils::lit> in_some_hole;
+        for (std::size_t h = 0; h < n_holes; ++h)
+        {
+            pigeon.push_back(php_sat.new_sat());
+            in_some_hole.emplace_back(pigeon.back(), true);
+        }
+        php_sat.add_constraint(php_sat.new_clause(std::move(in_some_hole)));
+    }
+    for (std::size_t h = 0; h < n_holes; ++h)
+        for (std::size_t i = 0; i < q.size(); ++i)
+            for (std::size_t j = i + 1; j < q.size(); ++j)
+                php_sat.add_constraint(php_sat.new_clause({{q[i][h], false}, {q[j][h], false}}));
+    sol = php_sat.solve(opts);
+    assert(sol);
+    for (std::size_t h = 0; h < n_holes; ++h)
+    {
+        std::size_t n_pigeons = 0;
+        for (const auto &pigeon : q)
+            if (php_sat.sat_val(pigeon[h]) == utils::True)
+                ++n_pigeons;
+        assert(n_pigeons == 1);
+    }
+
+    // a unit nogood, learned below a decision on an unrelated variable, is asserted at the root level
+    std::size_t n_asserted = 0;
+    for (unsigned seed = 1; seed <= 16; ++seed)
+    {
+        arc_consistency::solver us;
+        const auto w = us.new_sat();
+        const auto x = us.new_sat();
+        const auto y = us.new_sat();
+        const auto z = us.new_sat();
+        us.add_constraint(us.new_imply(x, arc_consistency::solver::True, y, arc_consistency::solver::True));
+        us.add_constraint(us.new_imply(x, arc_consistency::solver::True, z, arc_consistency::solver::True));
+        us.add_constraint(us.new_distinct(y, z));
+        arc_consistency::search_options unit_opts;
+        unit_opts.heuristic = arc_consistency::var_heuristic::dom;
+        unit_opts.learning = true;
+        unit_opts.seed = seed;
+        sol = us.solve(unit_opts);
+        assert(sol);
+        assert(us.sat_val(x) == utils::False);
+        us.add_constraint(us.new_forbid(w, arc_consistency::solver::False)); // back to the root level..
+        const auto prop = us.propagate();
+        assert(prop);
+        if (us.sat_val(x) == utils::False)
+            ++n_asserted;
+    }
+    assert(n_asserted > 0);
+}
+
+void test11()
+{
+    for (const std::size_t n_pigeons : {5, 6})
+    {
+        const std::size_t n_holes = 5;
+        arc_consistency::solver s;
+        std::vector<std::vector<utils::var>> p(n_pigeons);
+        for (auto &pigeon : p)
+        {
+            std::vector<utils::lit> in_some_hole;
+            for (std::size_t h = 0; h < n_holes; ++h)
+            {
+                pigeon.push_back(s.new_sat());
+                in_some_hole.emplace_back(pigeon.back(), true);
+            }
+            s.add_constraint(s.new_clause(std::move(in_some_hole)));
+        }
+        for (std::size_t h = 0; h < n_holes; ++h)
+            for (std::size_t i = 0; i < p.size(); ++i)
+                for (std::size_t j = i + 1; j < p.size(); ++j)
+                    s.add_constraint(s.new_clause({{p[i][h], false}, {p[j][h], false}}));
+
+        arc_consistency::portfolio pf(s, 4);
+        auto sol = pf.solve();
+        assert(sol == (n_pigeons <= n_holes));
+        if (!sol)
+        { // the workers stay inconsistent..
+            sol = pf.solve();
+            assert(!sol);
+        }
+        if (sol)
+            for (std::size_t h = 0; h < n_holes; ++h)
+            {
+                std::size_t n_in_hole = 0;
+                for (const auto &pigeon : p)
+                    if (pf.winner().sat_val(pigeon[h]) == utils::True)
+                        ++n_in_hole;
+                assert(n_in_hole == 1);
+            }
+        // the base solver is left untouched..
+        for (const auto &pigeon : p)
+            for (const auto &v : pigeon)
+                assert(s.domain(v).size() == 2);
+    }
+}
+
+void test12()
+{
+    test_enum_val a("A");
+    test_enum_val b("B");
+    test_enum_val c("C");
+
+    arc_consistency::solver s;
+    std::vector<utils::var> vars;
+    for (std::size_t i = 0; i < 1000; ++i)
+        vars.push_back(s.new_var({a, b, c}));
+    std::vector<arc_consistency::constraint *> eqs;
+    for (std::size_t i = 1; i < vars.size(); ++i)
+    {
+        eqs.push_back(&s.new_equal(vars[i - 1], vars[i]));
+        s.add_constraint(*eqs.back());
+    }
+    auto prop = s.propagate();
+    assert(prop);
+
+    // waking up constraints which prune nothing does not copy the shared pages..
+    auto f = s.fork();
+    auto &d = s.new_distinct(vars[10], vars[900]);
+    s.publish();
+    f->add_constraint(d);
+    s.add_constraint(d);
+    prop = f->propagate() && s.propagate();
+    assert(prop);
+    assert(&f->domain(vars[10]) == &s.domain(vars[10]) && &f->domain(vars[900]) == &s.domain(vars[900]));
+    assert(&s.snapshot()->domain(vars[10]) == &s.domain(vars[10]));
+    s.retract(d);
+    prop = s.propagate();
+    assert(prop);
+
+    auto f0 = s.fork();
+    f0->add_constraint(f0->new_assign(vars[0], a));
+    prop = f0->propagate();
+    assert(prop);
+    for (const auto &v : vars)
+    {
+        assert(f0->domain(v).size() == 1 && *f0->domain(v).begin() == &a);
+        assert(s.domain(v).size() == 3);
+    }
+
+    // the fork can retract the constraints of its parent, without affecting it..
+    auto f1 = f0->fork();
+    f1->retract(*eqs[499]);
+    f1->add_constraint(f1->new_forbid(vars[999], a));
+    prop = f1->propagate();
+    assert(prop);
+    assert(f1->domain(vars[499]).size() == 1 && *f1->domain(vars[499]).begin() == &a);
+    assert(f1->domain(vars[500]).size() == 2 && !f1->allows(vars[500], a));
+    assert(f0->domain(vars[999]).size() == 1 && *f0->domain(vars[999]).begin() == &a);
+
+    // the parent keeps working independently from its forks..
+    s.add_constraint(s.new_assign(vars[999], c));
+    prop = s.propagate();
+    assert(prop);
+    assert(s.domain(vars[0]).size() == 1 && *s.domain(vars[0]).begin() == &c);
+    assert(f0->domain(vars[0]).size() == 1 && *f0->domain(vars[0]).begin() == &a);
+    assert(f1->domain(vars[0]).size() == 1 && *f1->domain(vars[0]).begin() == &a);
+    auto sol = f1->solve();
+    assert(sol);
+    assert(*f1->domain(vars[500]).begin() != &a);
+}
+
+void test13()
+{
+    test_enum_val a("A");
+    test_enum_val b("B");
+    test_enum_val c("C");
+    const std::vector<std::reference_wrapper<const utils::enum_val>> vals{a, b, c};
+
+    arc_consistency::solver s;
+    std::vector<utils::var> vars;
+    for (std::size_t i = 0; i < 600; ++i)
+        vars.push_back(s.new_var({a, b, c}));
+    for (std::size_t i = 1; i < vars.size(); ++i)
+        s.add_constraint(s.new_equal(vars[i - 1], vars[i]));
+    auto prop = s.propagate();
+    assert(prop);
+    assert(!s.snapshot());
+    s.publish();
+
+    std::atomic<bool> done{false};
+    std::vector<std::thread> readers;
+    for (std::size_t r = 0; r < 2; ++r)
+        readers.emplace_back([&]
+                             {
+                                 std::size_t last_version = 0;
+                                 while (!done)
+                                 {
+                                     const auto snap = s.snapshot();
+                                     assert(snap->get_version() >= last_version);
+                                     last_version = snap->get_version();
+                                     // all the variables are equal at every fixpoint..
+                                     for (const auto &v : vars)
+                                         assert(snap->domain(v) == snap->domain(vars.front()));
+                                 } });
+
+    for (std::size_t i = 0; i < 30; ++i)
+    {
+        auto &asgn = s.new_assign(vars[(i * 7) % vars.size()], vals[i % vals.size()]);
+        s.add_constraint(asgn);
+        prop = s.propagate();
+        assert(prop);
+        s.publish();
+        assert(s.snapshot()->allows(vars.back(), vals[i % vals.size()]));
+        s.retract(asgn);
+        prop = s.propagate();
+        assert(prop);
+        s.publish();
+    }
+    done = true;
+    for (auto &r : readers)
+        r.join();
+    assert(s.snapshot()->get_version() == 61);
+    assert(s.snapshot()->domain(vars.back()).size() == 3);
+}
+
+void test14()
+{
+    arc_consistency::solver s;
+    std::vector<utils::var> vars;
+    std::vector<utils::lit> lits;
+    for (std::size_t i = 0; i < 4; ++i)
+    {
+        vars.push_back(s.new_sat());
+        lits.emplace_back(vars.back(), true);
+    }
+    auto &am = s.new_at_most(std::vector<utils::lit>(lits), 1);
+    s.add_constraint(am);
+    auto prop = s.propagate();
+    assert(prop);
+    for (const auto &v : vars)
+        assert(s.sat_val(v) == utils::Undefined);
+    auto &c0 = s.new_assign(vars[2], arc_consistency::solver::True);
+    s.add_constraint(c0);
+    prop = s.propagate();
+    assert(prop);
+    LOG_DEBUG(arc_consistency::to_string(s));
+    for (std::size_t i = 0; i < vars.size(); ++i)
+        assert(s.sat_val(vars[i]) == (i == 2 ? utils::True : utils::False));
+    s.retract(c0);
+    prop = s.propagate();
+    assert(prop);
+    for (const auto &v : vars)
+        assert(s.sat_val(v) == utils::Undefined);
+    s.retract(am);
+
+    // exactly two of the first three literals..
+    s.add_constraint(s.new_exactly({lits[0], lits[1], lits[2]}, 2));
+    s.add_constraint(s.new_forbid(vars[0], arc_consistency::solver::True));
+    prop = s.propagate();
+    assert(prop);
+    assert(s.sat_val(vars[0]) == utils::False);
+    assert(s.sat_val(vars[1]) == utils::True);
+    assert(s.sat_val(vars[2]) == utils::True);
+    s.add_constraint(s.new_forbid(vars[1], arc_consistency::solver::True)); // ..one false literal too many
+    prop = s.propagate();
+    assert(!prop);
+
+    // the counters follow the backtracking of the search..
+    arc_consistency::solver q;
+    std::vector<std::vector<utils::var>> board(6, std::vector<utils::var>(6));
+    for (auto &row : board)
+        for (auto &cell : row)
+            cell = q.new_sat();
+    for (std::size_t i = 0; i < board.size(); ++i)
+    {
+        std::vector<utils::lit> row, col;
+        for (std::size_t j = 0; j < board.size(); ++j)
+        {
+            row.emplace_back(board[i][j], true);
+            col.emplace_back(board[j][i], true);
+        }
+        q.add_constraint(q.new_exactly(std::move(row), 1));
+        q.add_constraint(q.new_exactly(std::move(col), 1));
+    }
+    for (int d = -5; d <= 5; ++d)
+    { // ..the diagonals of the six queens problem
+        std::vector<utils::lit> diag, anti_diag;
+        for (int i = 0; i < 6; ++i)
+            if (i + d >= 0 && i + d < 6)
+            {
+                diag.emplace_back(board[i][i + d], true);
+                anti_diag.emplace_back(board[i][5 - i - d], true);
+            }
+        q.add_constraint(q.new_at_most(std::move(diag), 1));
+        q.add_constraint(q.new_at_most(std::move(anti_diag), 1));
+    }
+    auto sol = q.solve();
+    assert(sol);
+    std::size_t n_queens = 0;
+    for (std::size_t i = 0; i < board.size(); ++i)
+        for (std::size_t j = 0; j < board.size(); ++j)
+            if (q.sat_val(board[i][j]) == utils::True)
+            {
+                ++n_queens;
+                for (std::size_t k = 0; k < board.size(); ++k)
+                    for (std::size_t l = 0; l < board.size(); ++l)
+                        if ((k != i || l != j) && q.sat_val(board[k][l]) == utils::True)
+                            assert(k != i && l != j && k + l != i + j && k + j != i + l);
+            }
+    assert(n_queens == 6);
+
+    // ..restoring them at every conflict of a refutation, here of five pigeons in four holes
+    arc_consistency::solver php;
+    std::vector<std::vector<utils::var>> in(5, std::vector<utils::var>(4));
+    for (auto &pigeon : in)
+        for (auto &hole : pigeon)
+            hole = php.new_sat();
+    for (const auto &pigeon : in)
+    {
+        std::vector<utils::lit> holes;
+        for (const auto &hole : pigeon)
+            holes.emplace_back(hole, true);
+        php.add_constraint(php.new_exactly(std::move(holes), 1));
+    }
+    for (std::size_t j = 0; j < 4; ++j)
+    {
+        std::vector<utils::lit> pigeons;
+        for (const auto &pigeon : in)
+            pigeons.emplace_back(pigeon[j], true);
+        php.add_constraint(php.new_at_most(std::move(pigeons), 1));
+    }
+    sol = php.propagate();
+    assert(sol);
+    sol = php.solve();
+    assert(!sol);
+}
+
+void test15()
+{
+    test_enum_val a("A");
+    test_enum_val b("B");
+    test_enum_val c("C");
+    test_enum_val d("D");
+
+    // y = {A ↦ B, B ↦ B, C ↦ C}[x]..
+    arc_consistency::solver s;
+    const auto x = s.new_var({a, b, c, d});
+    const auto y = s.new_var({a, b, c});
+    auto &el = s.new_element(y, x, {{a, b}, {b, b}, {c, c}});
+    s.add_constraint(el);
+    auto prop = s.propagate();
+    assert(prop);
+    LOG_DEBUG(arc_consistency::to_string(s));
+    assert(s.domain(x).size() == 3 && !s.domain(x).count(&d));
+    assert(s.domain(y).size() == 2 && !s.domain(y).count(&a));
+    auto &c0 = s.new_forbid(x, c);
+    s.add_constraint(c0);
+    prop = s.propagate();
+    assert(prop);
+    assert(s.domain(y).size() == 1 && *s.domain(y).begin() == &b);
+    s.retract(c0);
+    prop = s.propagate();
+    assert(prop);
+    assert(s.domain(y).size() == 2);
+    s.add_constraint(s.new_assign(y, c));
+    prop = s.propagate();
+    assert(prop);
+    assert(s.domain(x).size() == 1 && *s.domain(x).begin() == &c);
+
+    // at most one A, at least two B..
+    arc_consistency::solver g;
+    std::vector<utils::var> vars;
+    for (std::size_t i = 0; i < 3; ++i)
+        vars.push_back(g.new_var({a, b, c}));
+    g.add_constraint(g.new_gcc(std::vector<utils::var>(vars), {{a, 0, 1}, {b, 2, 3}}));
+    prop = g.propagate();
+    assert(prop);
+    auto &c1 = g.new_assign(vars[0], a);
+    g.add_constraint(c1);
+    prop = g.propagate();
+    assert(prop);
+    LOG_DEBUG(arc_consistency::to_string(g));
+    assert(g.domain(vars[1]).size() == 1 && *g.domain(vars[1]).begin() == &b);
+    assert(g.domain(vars[2]).size() == 1 && *g.domain(vars[2]).begin() == &b);
+    g.retract(c1);
+    prop = g.propagate();
+    assert(prop);
+    for (const auto &v : vars)
+        assert(g.domain(v).size() == 3);
+    g.add_constraint(g.new_forbid(vars[0], b));
+    g.add_constraint(g.new_forbid(vars[1], b));
+    prop = g.propagate(); // ..too few variables can take B
+    assert(!prop);
+
+    // the removals of other constraints might still be pending when the counters prune..
+    arc_consistency::solver w;
+    const auto w0 = w.new_var({a, b, c});
+    const auto w1 = w.new_var({a, b, c});
+    w.add_constraint(w.new_gcc({w0, w1}, {{a, 0, 1}}));
+    w.add_constraint(w.new_distinct(w0, w1));
+    prop = w.propagate();
+    assert(prop);
+    w.add_constraint(w.new_assign(w1, a));
+    prop = w.propagate();
+    assert(prop);
+    assert(w.domain(w0).size() == 2 && !w.domain(w0).count(&a));
+
+    // the counters follow the backtracking of the search..
+    arc_consistency::solver q;
+    std::vector<utils::var> xs;
+    for (std::size_t i = 0; i < 6; ++i)
+        xs.push_back(q.new_var({a, b, c}));
+    q.add_constraint(q.new_gcc(std::vector<utils::var>(xs), {{a, 1, 1}, {b, 2, 2}, {c, 3, 3}}));
+    for (std::size_t i = 0; i + 1 < xs.size(); ++i)
+        q.add_constraint(q.new_distinct(xs[i], xs[i + 1]));
+    auto sol = q.solve();
+    assert(sol);
+    std::size_t n_a = 0, n_b = 0, n_c = 0;
+    for (const auto &v : xs)
+    {
+        assert(q.domain(v).size() == 1);
+        const auto val = *q.domain(v).begin();
+        n_a += val == &a;
+        n_b += val == &b;
+        n_c += val == &c;
+    }
+    for (std::size_t i = 0; i + 1 < xs.size(); ++i)
+        assert(*q.domain(xs[i]).begin() != *q.domain(xs[i + 1]).begin());
+    assert(n_a == 1 && n_b == 2 && n_c == 3);
+}
+
+void test16()
+{
+    test_enum_val a("A");
+    test_enum_val b("B");
+    test_enum_val c("C");
+
+    // the first two variables share their universe, the third one does not..
+    arc_consistency::solver s;
+    const auto v0 = s.new_var({a, b, c});
+    const auto v1 = s.new_var({a, b, c});
+    const auto v2 = s.new_var({c, b, a});
+    assert(s.match(v0, v1) && s.match(v0, v2));
+    s.add_constraint(s.new_equal(v0, v1));
+    s.add_constraint(s.new_equal(v1, v2));
+    auto &c0 = s.new_forbid(v0, a);
+    s.add_constraint(c0);
+    auto prop = s.propagate();
+    assert(prop);
+    LOG_DEBUG(arc_consistency::to_string(s));
+    for (const auto &v : {v0, v1, v2})
+        assert(s.domain(v).size() == 2 && !s.allows(v, a));
+    s.add_constraint(s.new_forbid(v2, c));
+    prop = s.propagate();
+    assert(prop);
+    for (const auto &v : {v0, v1, v2})
+        assert(s.domain(v).size() == 1 && s.allows(v, b));
+    s.retract(c0);
+    prop = s.propagate();
+    assert(prop);
+    for (const auto &v : {v0, v1, v2})
+        assert(s.domain(v).size() == 2 && !s.allows(v, c));
+
+    const auto v3 = s.new_var({a, b, c});
+    s.add_constraint(s.new_forbid(v3, b));
+    prop = s.propagate();
+    assert(prop);
+    assert(s.match(v0, v3) && s.match(v2, v3));
+    s.add_constraint(s.new_forbid(v3, a));
+    prop = s.propagate();
+    assert(prop);
+    assert(!s.match(v0, v3) && !s.match(v2, v3));
+
+    // the bitsets follow the backtracking of the search..
+    arc_consistency::solver q;
+    std::vector<utils::var> xs;
+    for (std::size_t i = 0; i < 70; ++i)
+        xs.push_back(q.new_var({a, b, c}));
+    for (std::size_t i = 0; i + 1 < xs.size(); ++i)
+        q.add_constraint(i % 2 ? q.new_equal(xs[i], xs[i + 1]) : q.new_distinct(xs[i], xs[i + 1]));
+    q.add_constraint(q.new_forbid(xs.back(), a));
+    auto sol = q.solve();
+    assert(sol);
+    for (std::size_t i = 0; i + 1 < xs.size(); ++i)
+    {
+        assert(q.domain(xs[i]).size() == 1);
+        assert(q.match(xs[i], xs[i + 1]) == (i % 2 == 1));
+    }
+}
+
+void test17()
+{
+    test_enum_val a("A");
+    test_enum_val b("B");
+    test_enum_val c("C");
+
+    arc_consistency::solver s;
+    const auto v0 = s.new_var({a, b, c});
+    const auto v1 = s.new_var({a, b, c});
+    const auto v2 = s.new_var({a, b, c});
+    auto &f0 = s.new_forbid(v0, a);
+    s.add_constraint(f0);
+    auto &e0 = s.new_equal(v0, v1);
+    s.add_constraint(e0);
+    auto &e1 = s.new_equal(v1, v0);
+    s.add_constraint(e1);
+    s.add_constraint(s.new_distinct(v1, v2));
+    auto prop = s.propagate();
+    assert(prop);
+    auto report = s.presolve();
+    LOG_DEBUG(arc_consistency::to_string(s));
+    assert(report.folded == 1 && report.duplicates == 1 && report.subsumed == 0 && report.entailed == 0);
+    for (const auto &v : {v0, v1})
+        assert(s.domain(v).size() == 2 && !s.allows(v, a));
+
+    // the folded constraint is now part of the initial domain, and survives the retractions..
+    s.retract(e0);
+    prop = s.propagate();
+    assert(prop);
+    assert(!s.allows(v0, a) && !s.allows(v1, a));
+    s.retract(e1);
+    prop = s.propagate();
+    assert(prop);
+    assert(!s.allows(v0, a) && s.allows(v1, a));
+    s.add_constraint(s.new_equal(v0, v1));
+    prop = s.propagate();
+    assert(prop);
+    assert(!s.allows(v1, a));
+    s.retract(f0); // ..until it is retracted
+    prop = s.propagate();
+    assert(prop);
+    for (const auto &v : {v0, v1})
+        assert(s.domain(v).size() == 3);
+
+    // subsumed clauses and entailed constraints..
+    arc_consistency::solver q;
+    std::vector<utils::var> bs;
+    for (std::size_t i = 0; i < 4; ++i)
+        bs.push_back(q.new_sat());
+    q.add_constraint(q.new_clause({utils::lit(bs[0]), utils::lit(bs[1])}));
+    q.add_constraint(q.new_clause({utils::lit(bs[1]), utils::lit(bs[0])}));
+    auto &long_cl = q.new_clause({utils::lit(bs[0]), utils::lit(bs[1]), utils::lit(bs[2])});
+    q.add_constraint(long_cl);
+    auto &a0 = q.new_assign(bs[2], arc_consistency::solver::True);
+    q.add_constraint(a0);
+    auto &neq = q.new_distinct(bs[2], bs[3]);
+    q.add_constraint(neq);
+    prop = q.propagate();
+    assert(prop);
+    report = q.presolve();
+    assert(report.folded == 1 && report.duplicates == 1 && report.subsumed == 1 && report.entailed == 1);
+    assert(q.sat_val(bs[2]) == utils::True && q.sat_val(bs[3]) == utils::False);
+    q.retract(a0); // ..the entailed constraint is back
+    prop = q.propagate();
+    assert(prop);
+    assert(q.sat_val(bs[2]) == utils::Undefined && q.sat_val(bs[3]) == utils::Undefined);
+    q.add_constraint(q.new_assign(bs[3], arc_consistency::solver::True));
+    prop = q.propagate();
+    assert(prop);
+    assert(q.sat_val(bs[2]) == utils::False);
+    q.add_constraint(q.new_forbid(bs[0], arc_consistency::solver::True));
+    prop = q.propagate();
+    assert(prop);
+    assert(q.sat_val(bs[1]) == utils::True);
+}
+
+void test18()
+{
+    arc_consistency::sat_solver s;
+    std::vector<utils::var> bs;
+    for (std::size_t i = 0; i < 5; ++i)
+        bs.push_back(s.new_sat());
+    for (std::size_t i = 0; i + 1 < bs.size(); ++i) // b0 → b1 → .. → b4
+        s.add_constraint(s.new_imply(bs[i], arc_consistency::solver::True, bs[i + 1], arc_consistency::solver::True));
+    auto prop = s.propagate();
+    assert(prop);
+    for (const auto &b : bs)
+        assert(s.sat_val(b) == utils::Undefined);
+    auto &c0 = s.new_assign(bs[0], arc_consistency::solver::True);
+    s.add_constraint(c0);
+    prop = s.propagate();
+    assert(prop);
+    LOG_DEBUG(arc_consistency::to_string(s));
+    for (const auto &b : bs)
+        assert(s.sat_val(b) == utils::True);
+    auto &c1 = s.new_forbid(bs[4], arc_consistency::solver::True);
+    s.add_constraint(c1);
+    prop = s.propagate();
+    assert(!prop);
+    s.retract(c0);
+    prop = s.propagate();
+    assert(prop);
+    for (const auto &b : bs)
+        assert(s.sat_val(b) == utils::False);
+    s.add_constraint(s.new_equal(bs[1], bs[2]));
+    prop = s.propagate();
+    assert(prop);
+    s.add_constraint(s.new_distinct(bs[2], bs[3])); // ..both are forced to false by the implications
+    prop = s.propagate();
+    assert(!prop);
+
+    // retracting most of the constraints compacts the remaining clauses, which keep their literals..
+    arc_consistency::sat_solver r;
+    const auto r0 = r.new_sat();
+    const auto r1 = r.new_sat();
+    r.add_constraint(r.new_clause({utils::lit(r0), utils::lit(r1)}));
+    auto &r2 = r.new_assign(r0, arc_consistency::solver::True);
+    auto &r3 = r.new_assign(r1, arc_consistency::solver::True);
+    r.add_constraint(r2);
+    r.add_constraint(r3);
+    r.retract(r2);
+    r.retract(r3);
+    prop = r.propagate();
+    assert(prop);
+    r.add_constraint(r.new_forbid(r0, arc_consistency::solver::True));
+    prop = r.propagate();
+    assert(prop);
+    assert(r.sat_val(r1) == utils::True);
+
+    // the specialized solver agrees with the generic one on random 3-SAT instances..
+    std::mt19937 rng(42);
+    for (std::size_t n = 0; n < 20; ++n)
+    {
+        arc_consistency::solver g;
+        arc_consistency::sat_solver b;
+        std::vector<utils::var> g_vars, b_vars;
+        for (std::size_t i = 0; i < 12; ++i)
+        {
+            g_vars.push_back(g.new_sat());
+            b_vars.push_back(b.new_sat());
+        }
+        std::vector<std::vector<utils::lit>> cnf;
+        for (std::size_t i = 0; i < 52; ++i)
+        {
+            std::vector<utils::lit> g_cl, b_cl;
+            for (std::size_t j = 0; j < 3; ++j)
+            {
+                const auto v = rng() % g_vars.size();
+                const bool sign = rng() % 2;
+                g_cl.emplace_back(g_vars[v], sign);
+                b_cl.emplace_back(b_vars[v], sign);
+            }
+            g.add_constraint(g.new_clause(std::move(g_cl)));
+            b.add_constraint(b.new_clause(std::vector<utils::lit>(b_cl)));
+            cnf.push_back(std::move(b_cl));
+        }
+        const auto g_sol = g.solve();
+        const auto b_sol = b.solve();
+        assert(g_sol == b_sol);
+        if (b_sol)
+            for (const auto &cl : cnf)
+                assert(std::any_of(cl.begin(), cl.end(), [&b](const auto &l)
+                                   { return b.sat_val(l) == utils::True; }));
+    }
+
+    // the cardinality constraints are compiled into sequential counters..
+    arc_consistency::sat_solver c;
+    std::vector<utils::var> cs;
+    std::vector<utils::lit> c_lits;
+    for (std::size_t i = 0; i < 4; ++i)
+    {
+        cs.push_back(c.new_sat());
+        c_lits.emplace_back(cs.back());
+    }
+    c.add_constraint(c.new_at_most(std::vector<utils::lit>(c_lits), 1));
+    auto &c2 = c.new_assign(cs[2], arc_consistency::solver::True);
+    c.add_constraint(c2);
+    prop = c.propagate();
+    assert(prop);
+    assert(c.sat_val(cs[0]) == utils::False && c.sat_val(cs[1]) == utils::False && c.sat_val(cs[3]) == utils::False);
+    c.retract(c2);
+    auto &c3 = c.new_exactly(std::vector<utils::lit>(c_lits), 3);
+    c.add_constraint(c3);
+    auto sol = c.solve(); // ..at most one true literal, and at least three
+    assert(!sol);
+    c.retract(c3);
+    auto &c5 = c.new_exactly(std::vector<utils::lit>(c_lits), 5);
+    c.add_constraint(c5);
+    prop = c.propagate(); // ..more true literals than literals
+    assert(!prop);
+    c.retract(c5);
+    c.add_constraint(c.new_exactly(std::vector<utils::lit>(c_lits), 1));
+    for (std::size_t i = 0; i < 3; ++i)
+        c.add_constraint(c.new_forbid(cs[i], arc_consistency::solver::True));
+    prop = c.propagate(); // ..the last literal must be true
+    assert(prop);
+    assert(c.sat_val(cs[3]) == utils::True);
+
+    // ..and agree with the generic ones on random instances
+    for (std::size_t n = 0; n < 50; ++n)
+    {
+        arc_consistency::solver g;
+        arc_consistency::sat_solver b;
+        std::vector<utils::var> g_vars, b_vars;
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            g_vars.push_back(g.new_sat());
+            b_vars.push_back(b.new_sat());
+        }
+        std::vector<std::tuple<std::vector<utils::lit>, std::size_t, bool>> cards;
+        for (std::size_t i = 0; i < 5; ++i)
+        {
+            std::vector<utils::lit> g_lits, b_lits;
+            const auto size = 2 + rng() % 5;
+            for (std::size_t j = 0; j < size; ++j)
+            {
+                const auto v = rng() % g_vars.size();
+                const bool sign = rng() % 2;
+                g_lits.emplace_back(g_vars[v], sign);
+                b_lits.emplace_back(b_vars[v], sign);
+            }
+            const std::size_t k = rng() % (size + 1);
+            const bool exact = rng() % 2;
+            g.add_constraint(exact ? g.new_exactly(std::move(g_lits), k) : g.new_at_most(std::move(g_lits), k));
+            b.add_constraint(exact ? b.new_exactly(std::vector<utils::lit>(b_lits), k) : b.new_at_most(std::vector<utils::lit>(b_lits), k));
+            cards.emplace_back(std::move(b_lits), k, exact);
+        }
+        const auto g_sol = g.solve();
+        const auto b_sol = b.solve();
+        assert(g_sol == b_sol);
+        if (b_sol)
+            for (const auto &[lits, k, exact] : cards)
+            {
+                const auto n_true = static_cast<std::size_t>(std::count_if(lits.begin(), lits.end(), [&b](const auto &l)
+                                                                           { return b.sat_val(l) == utils::True; }));
+                assert(exact ? n_true == k : n_true <= k);
+            }
+    }
+}
+
+void test19()
+{
+    arc_consistency::solver s;
+    std::vector<utils::var> bs;
+    for (std::size_t i = 0; i < 100; ++i)
+        bs.push_back(s.new_sat());
+    auto before = s.memory_usage();
+    assert(before.domains > 0 && before.init_domains > 0 && before.watchlists > 0);
+    assert(before.constraints.empty());
+
+    // a bulk load of clauses on the first variable..
+    std::vector<std::reference_wrapper<arc_consistency::constraint>> cls;
+    for (std::size_t i = 1; i < bs.size(); ++i)
+    {
+        cls.emplace_back(s.new_clause({utils::lit(bs[0]), utils::lit(bs[i])}));
+        s.add_constraint(cls.back());
+    }
+    s.add_constraint(s.new_at_most({utils::lit(bs[1]), utils::lit(bs[2]), utils::lit(bs[3])}, 1));
+    auto prop = s.propagate();
+    assert(prop);
+    auto loaded = s.memory_usage();
+    LOG_DEBUG("Memory usage: " + std::to_string(loaded.total()) + " bytes");
+    assert(loaded.watchlists > before.watchlists);
+    assert(loaded.constraints.at(typeid(arc_consistency::clause)) >= cls.size() * sizeof(arc_consistency::clause));
+    assert(loaded.constraints.count(typeid(arc_consistency::cardinality)));
+    assert(loaded.total() > before.total());
+
+    // ..retracted, leaves some spare capacity to be released
+    for (auto &c : cls)
+        s.retract(c);
+    prop = s.propagate();
+    assert(prop);
+    auto retracted = s.memory_usage();
+    s.shrink_to_fit();
+    auto shrunk = s.memory_usage();
+    assert(shrunk.watchlists < retracted.watchlists);
+    assert(shrunk.total() < retracted.total());
+    for (const auto &b : bs)
+        assert(s.sat_val(b) == utils::Undefined);
+}
+
+#ifdef ARCCONSISTENCY_ENABLE_TRACE
+void test20()
+{
+    test_enum_val a("A");
+    test_enum_val b("B");
+    test_enum_val c("C");
+
+    arc_consistency::trace_buffer buffer;
+    arc_consistency::solver s;
+    s.set_trace(&buffer);
+    std::vector<utils::var> xs;
+    for (std::size_t i = 0; i < 8; ++i)
+        xs.push_back(s.new_var({a, b, c}));
+    for (std::size_t i = 0; i < xs.size(); ++i)
+        for (std::size_t j = i + 1; j < xs.size(); ++j)
+            if ((i + j) % 3)
+                s.add_constraint(s.new_distinct(xs[i], xs[j]));
+    auto &c0 = s.new_assign(xs[0], a);
+    s.add_constraint(c0);
+
+    // the events are read, and formatted, by another thread..
+    std::atomic<bool> done = false;
+    std::size_t n_events[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+    std::thread reader([&buffer, &done, &n_events]
+                       {
+                           const auto read = [&n_events](const arc_consistency::trace_event &e)
+                           {
+                               ++n_events[static_cast<std::size_t>(e.kind)];
+                               LOG_DEBUG(arc_consistency::to_string(e));
+                           };
+                           while (!done)
+                               buffer.drain(read);
+                           buffer.drain(read); });
+    auto prop = s.propagate();
+    assert(prop);
+    auto sol = s.solve();
+    s.retract(c0);
+    done = true;
+    reader.join();
+    LOG_DEBUG("Dropped events: " + std::to_string(buffer.dropped()));
+    assert(n_events[static_cast<std::size_t>(arc_consistency::trace_kind::propagate)] > 0);
+    assert(n_events[static_cast<std::size_t>(arc_consistency::trace_kind::remove)] > 0);
+    assert(n_events[static_cast<std::size_t>(arc_consistency::trace_kind::retract)] == 1 || buffer.dropped() > 0);
+    assert(sol || n_events[static_cast<std::size_t>(arc_consistency::trace_kind::conflict)] > 0);
+
+    // ..and dropped, rather than waited for, when the buffer is full
+    arc_consistency::trace_buffer small(4);
+    s.set_trace(&small);
+    s.add_constraint(s.new_assign(xs[1], b));
+    prop = s.propagate();
+    s.set_trace(nullptr);
+    std::vector<arc_consistency::trace_event> events;
+    const auto n_read = small.drain([&events](const auto &e)
+                                    { events.push_back(e); });
+    assert(n_read == 4 && events.size() == 4);
+    assert(small.dropped() > 0);
+    assert(events[0].kind == arc_consistency::trace_kind::propagate);
+
+    // the learned nogoods, forgotten along the search, can be formatted once the search is over
+    arc_consistency::trace_buffer learnt_buffer(1 << 20);
+    arc_consistency::solver php;
+    php.set_trace(&learnt_buffer);
+    std::vector<std::vector<utils::var>> p(6);
+    for (auto &pigeon : p)
+    {
+        std::vector<utils::lit> in_some_hole;
+        for (std::size_t h = 0; h < 5; ++h)
+        {
+            pigeon.push_back(php.new_sat());
+            in_some_hole.emplace_back(pigeon.back(), true);
+        }
+        php.add_constraint(php.new_clause(std::move(in_some_hole)));
+    }
+    for (std::size_t h = 0; h < 5; ++h)
+        for (std::size_t i = 0; i < p.size(); ++i)
+            for (std::size_t j = i + 1; j < p.size(); ++j)
+                php.add_constraint(php.new_clause({{p[i][h], false}, {p[j][h], false}}));
+    arc_consistency::search_options opts;
+    opts.learning = true;
+    opts.max_learnts = 4;
+    sol = php.solve(opts);
+    assert(!sol);
+    php.set_trace(nullptr);
+    std::size_t n_nogood_events = 0, n_learnt = 0, n_refuted = 0;
+    learnt_buffer.drain([&n_nogood_events, &n_learnt, &n_refuted](const arc_consistency::trace_event &e)
+                        {
+                            if (!e.c && e.nogood)
+                                ++n_nogood_events;
+                            if (e.kind == arc_consistency::trace_kind::learn)
+                                ++n_learnt;
+                            if (e.kind == arc_consistency::trace_kind::refute)
+                                ++n_refuted;
+                            assert(!arc_consistency::to_string(e).empty()); });
+    assert(n_nogood_events > n_learnt && n_learnt > 0);
+    assert(n_refuted > 0);
+}
+#endif
+
 int main()
 {
     test0();
@@ -199,6 +1293,22 @@ int main()
     test4();
     test5();
     test6();
+    test7();
+    test8();
+    test9();
+    test10();
+    test11();
+    test12();
+    test13();
+    test14();
+    test15();
+    test16();
+    test17();
+    test18();
+    test19();
+#ifdef ARCCONSISTENCY_ENABLE_TRACE
+    test20();
+#endif
 
     return 0;
 }
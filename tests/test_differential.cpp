@@ -0,0 +1,344 @@
+#include "arc_consistency.hpp"
+#include "logging.hpp"
+#include <cassert>
+#include <chrono>
+#include <random>
+#include <string>
+
+class test_enum_val : public utils::enum_val
+{
+public:
+    explicit test_enum_val(std::string name) : name(std::move(name)) {}
+
+    std::string to_string() const override { return name; }
+
+private:
+    std::string name;
+};
+
+using domain = std::unordered_set<const utils::enum_val *>;
+using assignment = std::vector<const utils::enum_val *>;
+
+/**
+ * @brief A constraint of the reference network, given as a predicate over the values of its (distinct) variables.
+ */
+struct reference_constraint
+{
+    std::vector<utils::var> scope;
+    std::function<bool(const assignment &)> pred;
+    arc_consistency::constraint *c; // the corresponding constraint of the solver
+    bool active;
+};
+
+/**
+ * @brief A naive AC-3 over the active constraints, enumerating the tuples of their scopes to find the supports.
+ */
+class reference_ac3
+{
+public:
+    reference_ac3(const std::vector<domain> &init_domain, const std::vector<reference_constraint> &constraints) noexcept : init_domain(init_domain), constraints(constraints) {}
+
+    /**
+     * @brief Computes, from the initial domains, the arc consistent domains, returning false on a domain wipeout.
+     */
+    bool propagate() noexcept
+    {
+        dom = init_domain;
+        std::vector<std::vector<std::size_t>> watches(dom.size());
+        std::vector<std::size_t> queue;
+        std::vector<bool> queued(constraints.size(), false);
+        for (std::size_t i = 0; i < constraints.size(); ++i)
+            if (constraints[i].active)
+            {
+                for (const auto &v : constraints[i].scope)
+                    watches[v].push_back(i);
+                queue.push_back(i);
+                queued[i] = true;
+            }
+        while (!queue.empty())
+        {
+            const auto i = queue.back();
+            queue.pop_back();
+            queued[i] = false;
+            const auto &c = constraints[i];
+            for (std::size_t pos = 0; pos < c.scope.size(); ++pos)
+            {
+                std::vector<const utils::enum_val *> unsupported;
+                for (const auto &val : dom[c.scope[pos]])
+                {
+                    assignment tuple(c.scope.size());
+                    tuple[pos] = val;
+                    if (!supported(c, tuple, 0, pos))
+                        unsupported.push_back(val);
+                }
+                if (unsupported.empty())
+                    continue;
+                for (const auto &val : unsupported)
+                    dom[c.scope[pos]].erase(val);
+                if (dom[c.scope[pos]].empty())
+                    return false;
+                for (const auto &j : watches[c.scope[pos]])
+                    if (!queued[j])
+                    {
+                        queue.push_back(j);
+                        queued[j] = true;
+                    }
+            }
+        }
+        return true;
+    }
+
+    const domain &get_domain(utils::var v) const noexcept { return dom[v]; }
+
+private:
+    bool supported(const reference_constraint &c, assignment &tuple, std::size_t i, std::size_t fixed) const noexcept
+    {
+        if (i == c.scope.size())
+            return c.pred(tuple);
+        if (i == fixed)
+            return supported(c, tuple, i + 1, fixed);
+        for (const auto &val : dom[c.scope[i]])
+        {
+            tuple[i] = val;
+            if (supported(c, tuple, i + 1, fixed))
+                return true;
+        }
+        return false;
+    }
+
+private:
+    const std::vector<domain> &init_domain;
+    const std::vector<reference_constraint> &constraints;
+    std::vector<domain> dom;
+};
+
+struct timings
+{
+    std::chrono::nanoseconds solver{0};
+    std::chrono::nanoseconds reference{0};
+    std::size_t n_ops = 0;
+};
+
+/**
+ * @brief Runs a random sequence of additions, retractions and presolves, checking the domains of the solver against the reference after each of them.
+ */
+void run(unsigned seed, std::size_t n_ops, timings &t)
+{
+    std::mt19937 rng(seed);
+    test_enum_val a("A"), b("B"), c("C"), d("D");
+    const std::vector<std::reference_wrapper<const utils::enum_val>> vals{a, b, c, d};
+
+    arc_consistency::solver s;
+    std::vector<domain> init_domain;
+    std::vector<utils::var> enums, sats;
+    init_domain.push_back({&arc_consistency::solver::False}); // the constant false variable of the solver
+    for (std::size_t i = 0; i < 5; ++i)
+    {
+        sats.push_back(s.new_sat());
+        init_domain.push_back({&arc_consistency::solver::True, &arc_consistency::solver::False});
+    }
+    for (std::size_t i = 0; i < 6; ++i)
+    { // some variables share the whole universe, others have a random subset of it..
+        std::vector<std::reference_wrapper<const utils::enum_val>> var_vals;
+        for (const auto &val : vals)
+            if (i < 3 || rng() % 3)
+                var_vals.push_back(val);
+        if (var_vals.empty())
+            var_vals.push_back(vals[rng() % vals.size()]);
+        enums.push_back(s.new_var(var_vals));
+        init_domain.emplace_back();
+        for (const auto &val : var_vals)
+            init_domain.back().insert(&val.get());
+    }
+
+    std::vector<reference_constraint> constraints;
+    reference_ac3 ref(init_domain, constraints);
+    const auto pick = [&rng](const std::vector<utils::var> &vars, std::size_t n)
+    {
+        std::vector<utils::var> picked(vars);
+        std::shuffle(picked.begin(), picked.end(), rng);
+        picked.resize(n);
+        return picked;
+    };
+    const auto lit_val = [](const utils::lit &l) -> const utils::enum_val *
+    { return utils::sign(l) ? &arc_consistency::solver::True : &arc_consistency::solver::False; };
+
+    for (std::size_t op = 0; op < n_ops; ++op)
+    {
+        std::size_t n_active = 0;
+        for (const auto &rc : constraints)
+            n_active += rc.active;
+        const auto kind = rng() % 20;
+        std::chrono::steady_clock::time_point start;
+        bool consistent;
+        if (kind < 4 && n_active)
+        { // we retract a random active constraint..
+            auto idx = rng() % n_active;
+            for (auto &rc : constraints)
+                if (rc.active && idx-- == 0)
+                {
+                    rc.active = false;
+                    start = std::chrono::steady_clock::now();
+                    s.retract(*rc.c);
+                    break;
+                }
+        }
+        else if (kind == 4)
+        { // ..or we presolve..
+            start = std::chrono::steady_clock::now();
+            s.presolve();
+        }
+        else
+        { // ..or we add a random constraint
+            reference_constraint rc;
+            switch (kind % 8)
+            {
+            case 0:
+            {
+                const auto x = pick(enums, 1)[0];
+                const auto val = &vals[rng() % vals.size()].get();
+                const bool as = rng() % 2;
+                if (!init_domain[x].count(val) || (as && !s.allows(x, *val)))
+                    continue; // the value must be in the domain of the variable
+                rc.scope = {x};
+                rc.pred = [val, as](const assignment &t)
+                { return (t[0] == val) == as; };
+                rc.c = as ? &s.new_assign(x, *val) : &s.new_forbid(x, *val);
+                break;
+            }
+            case 1:
+            case 2:
+            {
+                const auto xy = pick(enums, 2);
+                const bool eq = kind % 8 == 1;
+                rc.scope = xy;
+                rc.pred = [eq](const assignment &t)
+                { return (t[0] == t[1]) == eq; };
+                rc.c = eq ? &s.new_equal(xy[0], xy[1]) : &s.new_distinct(xy[0], xy[1]);
+                break;
+            }
+            case 3:
+            {
+                const auto xy = pick(enums, 2);
+                const auto p_val = &vals[rng() % vals.size()].get();
+                const auto c_val = &vals[rng() % vals.size()].get();
+                if (!init_domain[xy[0]].count(p_val) || !init_domain[xy[1]].count(c_val))
+                    continue;
+                rc.scope = xy;
+                rc.pred = [p_val, c_val](const assignment &t)
+                { return t[0] != p_val || t[1] == c_val; };
+                rc.c = &s.new_imply(xy[0], *p_val, xy[1], *c_val);
+                break;
+            }
+            case 4:
+            case 5:
+            {
+                const auto vars = pick(sats, 1 + rng() % 3);
+                std::vector<utils::lit> lits;
+                for (const auto &v : vars)
+                    lits.emplace_back(v, rng() % 2);
+                rc.scope = vars;
+                if (kind % 8 == 4)
+                {
+                    rc.pred = [lits, lit_val](const assignment &t)
+                    {
+                        for (std::size_t i = 0; i < lits.size(); ++i)
+                            if (t[i] == lit_val(lits[i]))
+                                return true;
+                        return false;
+                    };
+                    rc.c = &s.new_clause(std::move(lits));
+                }
+                else
+                {
+                    const std::size_t k = rng() % lits.size();
+                    const bool exact = rng() % 2;
+                    rc.pred = [lits, lit_val, k, exact](const assignment &t)
+                    {
+                        std::size_t n_true = 0;
+                        for (std::size_t i = 0; i < lits.size(); ++i)
+                            n_true += t[i] == lit_val(lits[i]);
+                        return exact ? n_true == k : n_true <= k;
+                    };
+                    rc.c = exact ? &s.new_exactly(std::move(lits), k) : &s.new_at_most(std::move(lits), k);
+                }
+                break;
+            }
+            default:
+            {
+                const auto yx = pick(enums, 2);
+                std::vector<std::pair<std::reference_wrapper<const utils::enum_val>, std::reference_wrapper<const utils::enum_val>>> table;
+                std::unordered_map<const utils::enum_val *, const utils::enum_val *> mapping;
+                for (const auto &x_val : vals)
+                    if (rng() % 4)
+                    {
+                        const auto &y_val = vals[rng() % vals.size()];
+                        table.emplace_back(x_val, y_val);
+                        mapping.emplace(&x_val.get(), &y_val.get());
+                    }
+                rc.scope = yx;
+                rc.pred = [mapping](const assignment &t)
+                {
+                    const auto it = mapping.find(t[1]);
+                    return it != mapping.end() && it->second == t[0];
+                };
+                rc.c = &s.new_element(yx[0], yx[1], table);
+                break;
+            }
+            }
+            rc.active = true;
+            constraints.push_back(std::move(rc));
+            start = std::chrono::steady_clock::now();
+            s.add_constraint(*constraints.back().c);
+        }
+        consistent = s.propagate();
+        t.solver += std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        const auto ref_consistent = ref.propagate();
+        t.reference += std::chrono::steady_clock::now() - start;
+        ++t.n_ops;
+
+        if (consistent != ref_consistent)
+        {
+            LOG_WARN("Seed " + std::to_string(seed) + ", operation " + std::to_string(op) + ": the solver is " + (consistent ? "" : "in") + "consistent, the reference is not");
+            LOG_WARN(arc_consistency::to_string(s));
+        }
+        assert(consistent == ref_consistent);
+        if (!consistent)
+        { // the last added constraint made the network inconsistent, so we take it back..
+            assert(constraints.back().active);
+            constraints.back().active = false;
+            s.retract(*constraints.back().c);
+            consistent = s.propagate();
+            assert(consistent);
+            const auto ref_consistent = ref.propagate();
+            assert(ref_consistent);
+        }
+        for (utils::var v = 0; v < init_domain.size(); ++v)
+        {
+            if (s.domain(v) != ref.get_domain(v))
+            {
+                LOG_WARN("Seed " + std::to_string(seed) + ", operation " + std::to_string(op) + ": the domains of v" + std::to_string(v) + " differ");
+                LOG_WARN(arc_consistency::to_string(s));
+            }
+            assert(s.domain(v) == ref.get_domain(v));
+        }
+    }
+}
+
+int main(int argc, char const *argv[])
+{
+    const std::size_t n_runs = argc > 1 ? std::stoul(argv[1]) : 50;
+    const std::size_t n_ops = argc > 2 ? std::stoul(argv[2]) : 100;
+    const unsigned first_seed = argc > 3 ? static_cast<unsigned>(std::stoul(argv[3])) : 1;
+
+    timings t;
+    for (unsigned seed = first_seed; seed < first_seed + n_runs; ++seed)
+        run(seed, n_ops, t);
+    LOG_INFO("Operations: " + std::to_string(t.n_ops));
+    LOG_INFO("Solver: " + std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(t.solver).count()) + " µs");
+    LOG_INFO("Reference AC-3: " + std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(t.reference).count()) + " µs");
+
+    return 0;
+}